@@ -15,10 +15,19 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <time.h>
 #include <esp_err.h>
 #include "project_config.h"
 #include "driver/i2c.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "reLCDPlanner.h"
+#include "driver/gpio.h"
+#include "soc/soc_caps.h"
+#if SOC_DEDICATED_GPIO_SUPPORTED
+  #include "driver/dedic_gpio.h"
+#endif // SOC_DEDICATED_GPIO_SUPPORTED
 
 // EN: Flags for display entry mode
 // RU: Флаги режима ввода отображения
@@ -57,6 +66,13 @@
 #define LCD_BACKLIGHT           0x08 // B00001000
 #define LCD_NOBACKLIGHT         0x00 // B00000000
 
+// EN: Lines of the parallel interface: bits 0-7 are D0-D7
+// RU: Линии параллельного интерфейса: биты 0-7 - это D0-D7
+#define LCD_PIN_RS              0x0100
+#define LCD_PIN_RW              0x0200
+#define LCD_PIN_EN              0x0400
+#define LCD_PIN_BL              0x0800
+
 // EN: Values for graphtype in calls to init_bargraph and character geometry
 // RU: Значения для graphtype в вызовах init_bargraph и геометрии символов
 #define LCDI2C_VERTICAL_BAR_GRAPH     1
@@ -65,6 +81,14 @@
 #define LCD_CHARACTER_HORIZONTAL_DOTS 5
 #define LCD_CHARACTER_VERTICAL_DOTS   8
 
+// EN: Maximum display size. DDRAM holds 40 chars per row on 1 and 2 row displays and 20 on 4 row ones,
+//     chars beyond the visible columns are shown by scrolling
+// RU: Максимальный размер дисплея. DDRAM вмещает 40 символов в строке на 1 и 2 строчных дисплеях и 20 на 4 строчных,
+//     символы за видимыми столбцами показываются прокруткой
+#define LCD_MAX_COLS                  20
+#define LCD_MAX_ROWS                  4
+#define LCD_DDRAM_COLS                40
+
 // EN: If the display has russian characters, define CONFIG_LCD_RUS_CODEPAGE 1
 // RU: Если в дисплее есть русские символы, определите CONFIG_LCD_RUS_CODEPAGE 1
 #if defined(CONFIG_LCD_RUS_CODEPAGE) && (CONFIG_LCD_RUS_CODEPAGE == 1)
@@ -73,23 +97,169 @@
   #define LCD_RUS_USE_CUSTOM_CHARS 1
 #endif
 
+// EN: Size of the transmit buffer: bytes sent to PCF8574 in one I2C transaction (6 bytes per command or character)
+// RU: Размер буфера передачи: байты, отправляемые в PCF8574 за одну транзакцию I2C (6 байт на команду или символ)
+#ifndef CONFIG_LCD_TX_BUFFER_SIZE
+  #define CONFIG_LCD_TX_BUFFER_SIZE 120
+#endif // CONFIG_LCD_TX_BUFFER_SIZE
+static_assert(CONFIG_LCD_TX_BUFFER_SIZE >= 6, "CONFIG_LCD_TX_BUFFER_SIZE must hold at least one command (6 bytes)");
+
+// EN: Timeout of one I2C transaction, ms
+// RU: Таймаут одной транзакции I2C, мс
+#ifndef CONFIG_LCD_I2C_TIMEOUT
+  #define CONFIG_LCD_I2C_TIMEOUT 100
+#endif // CONFIG_LCD_I2C_TIMEOUT
+
+// EN: Number of bytes transmitted via I2C in the specified time (9 clocks per byte), for setBusSlice() and setFrameBudget()
+// RU: Количество байт, передаваемых по I2C за указанное время (9 тактов на байт), для setBusSlice() и setFrameBudget()
+#define LCD_I2C_BYTES(time_us, freq_hz) ((uint32_t)(time_us) * ((freq_hz) / 1000) / 9000)
+
+// EN: If CONFIG_LCD_TX_PIPELINE 1, buffers are sent by a separate task while the next one is being encoded
+// RU: Если CONFIG_LCD_TX_PIPELINE 1, буферы отправляются отдельной задачей, пока кодируется следующий
+#ifndef CONFIG_LCD_TX_PIPELINE
+  #define CONFIG_LCD_TX_PIPELINE 0
+#endif // CONFIG_LCD_TX_PIPELINE
+
+#if CONFIG_LCD_TX_PIPELINE
+  #include "freertos/task.h"
+  #ifndef CONFIG_LCD_TX_TASK_STACK_SIZE
+    #define CONFIG_LCD_TX_TASK_STACK_SIZE 2048
+  #endif // CONFIG_LCD_TX_TASK_STACK_SIZE
+  #ifndef CONFIG_LCD_TX_TASK_PRIORITY
+    #define CONFIG_LCD_TX_TASK_PRIORITY 10
+  #endif // CONFIG_LCD_TX_TASK_PRIORITY
+  #define LCD_TX_BUFFERS 2
+#else
+  #define LCD_TX_BUFFERS 1
+#endif // CONFIG_LCD_TX_PIPELINE
+
+// EN: Low priority cells are not deferred longer than this time (ms), even if the bus is busy
+// RU: Ячейки с низким приоритетом не откладываются дольше этого времени (мс), даже если шина занята
+#ifndef CONFIG_LCD_LOW_PRIORITY_MAX_DEFER
+  #define CONFIG_LCD_LOW_PRIORITY_MAX_DEFER 1000
+#endif // CONFIG_LCD_LOW_PRIORITY_MAX_DEFER
+
+// EN: Display state for the screen mirror
+// RU: Состояние дисплея для зеркала экрана
+typedef struct {
+  uint8_t cols;
+  uint8_t rows;
+  uint8_t width;        // EN: DDRAM chars per row, see getScreenRow() / RU: символов DDRAM в строке, см. getScreenRow()
+  uint8_t col;          // EN: cursor position / RU: позиция курсора
+  uint8_t row;
+  uint8_t shift;        // EN: display shift, the first visible DDRAM column / RU: сдвиг дисплея, первый видимый столбец DDRAM
+  uint8_t control;      // LCD_DISPLAYON | LCD_CURSORON | LCD_BLINKON
+  uint8_t mode;         // LCD_ENTRYLEFT | LCD_ENTRYSHIFTINCREMENT
+  bool    backlight;
+} lcd_state_t;
+
+// EN: If CONFIG_LCD_STATS 1, the driver collects counters and latency histograms, see getStats()
+// RU: Если CONFIG_LCD_STATS 1, драйвер собирает счетчики и гистограммы задержек, см. getStats()
+#ifndef CONFIG_LCD_STATS
+  #define CONFIG_LCD_STATS 0
+#endif // CONFIG_LCD_STATS
+
+#if CONFIG_LCD_STATS
+
+// EN: Groups of public calls for latency histograms
+// RU: Группы публичных вызовов для гистограмм задержек
+typedef enum {
+  LCD_CALL_CLEAR = 0,     // clear()
+  LCD_CALL_HOME,          // home()
+  LCD_CALL_COMMAND,       // setCursor(), setDisplay() and other options, scroll
+  LCD_CALL_WRITE,         // write()
+  LCD_CALL_PRINT,         // printstr(), printpos(), printf()
+  LCD_CALL_PRINTN,        // printn()
+  LCD_CALL_CREATECHAR,    // createChar(), startAnimation()
+  LCD_CALL_GRAPH,         // init_bargraph(), draw_horizontal_graph(), draw_vertical_graph()
+  LCD_CALL_UPDATE,        // update()
+  LCD_CALL_MAX
+} lcd_call_t;
+
+// EN: Histogram buckets: < 16 us, < 64 us, < 256 us, < 1 ms, < 4 ms, < 16 ms, < 64 ms, >= 64 ms
+// RU: Интервалы гистограмм: < 16 мкс, < 64 мкс, < 256 мкс, < 1 мс, < 4 мс, < 16 мс, < 64 мс, >= 64 мс
+#define LCD_STATS_BUCKETS 8
+
+typedef struct {
+  uint32_t transactions;      // EN: I2C transactions / RU: транзакции I2C
+  uint32_t bytes;             // EN: bytes sent to the display / RU: байты, отправленные на дисплей
+  uint32_t failures;          // EN: failed transactions / RU: транзакции, завершившиеся ошибкой
+  uint32_t resyncs;           // EN: reinitializations of the display after a failure / RU: повторные инициализации дисплея после ошибки
+  uint32_t busy_wait_us;      // EN: time spent in busy waits / RU: время активного ожидания
+  uint32_t cgram_uploads;     // EN: CGRAM images changed / RU: изменено изображений в CGRAM
+  uint32_t cgram_evictions;   // EN: russian chars dropped because CGRAM is full / RU: сбросов русских символов из-за переполнения CGRAM
+  uint32_t cells_sent;        // EN: cells sent to the display / RU: ячеек отправлено на дисплей
+  uint32_t cells_skipped;     // EN: changed cells that did not need sending / RU: измененных ячеек, которые не потребовалось отправлять
+  uint32_t latency[LCD_CALL_MAX][LCD_STATS_BUCKETS];
+  uint32_t visible[LCD_STATS_BUCKETS]; // EN: from a change of the frame to sending it / RU: от изменения кадра до его отправки
+} lcd_stats_t;
+
+#endif // CONFIG_LCD_STATS
+
+// EN: Update priority of display cells
+// RU: Приоритет обновления ячеек дисплея
+typedef enum {
+  LCD_PRIORITY_LOW = 0,     // EN: may be deferred when the bus is busy / RU: может быть отложено при занятой шине
+  LCD_PRIORITY_NORMAL,      // EN: sent with the next frame / RU: отправляется со следующим кадром
+  LCD_PRIORITY_HIGH         // EN: sent immediately, bypassing the frame rate / RU: отправляется сразу, минуя ограничение частоты кадров
+} lcd_priority_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 #define MAX_CUSTOM_CHARS 8
 
+// EN: Direct connection of the display to GPIO (rw and backlight may be GPIO_NUM_NC)
+// RU: Прямое подключение дисплея к GPIO (rw и backlight могут быть GPIO_NUM_NC)
+typedef struct {
+  gpio_num_t rs;
+  gpio_num_t rw;
+  gpio_num_t en;
+  gpio_num_t data[8];     // EN: D0-D7, in 4-bit mode only D4-D7 are used / RU: D0-D7, в 4-битном режиме используются только D4-D7
+  gpio_num_t backlight;
+  uint8_t    bitmode;     // LCD_4BITMODE or LCD_8BITMODE
+} lcd_gpio_config_t;
+
+// EN: Replaces the GPIO output, for example with a simulator: mask - changed lines, value - their states (LCD_PIN_xxx)
+// RU: Заменяет вывод на GPIO, например на симулятор: mask - изменяемые линии, value - их состояния (LCD_PIN_xxx)
+typedef void (*lcd_pin_writer_t)(void* arg, uint16_t mask, uint16_t value);
+// EN: Replaces the waits of the driver (busy waits and task delays), for example to count the time of a simulator
+// RU: Заменяет ожидания драйвера (активные и задержки задачи), например для подсчета времени симулятора
+typedef void (*lcd_pin_delay_t)(void* arg, uint32_t us);
+
+// EN: Animated custom character: images of the frames are changed every interval_ms
+// RU: Анимированный пользовательский символ: изображения кадров сменяются каждые interval_ms
+typedef struct {
+  const uint8_t (*frames)[LCD_CHARACTER_VERTICAL_DOTS];
+  uint8_t  count;
+  uint16_t interval_ms;
+} lcd_animation_t;
+
+// EN: Built-in animations
+// RU: Встроенные анимации
+extern const lcd_animation_t lcd_anim_spinner;
+extern const lcd_animation_t lcd_anim_wifi;
+extern const lcd_animation_t lcd_anim_battery;
+
+// EN: All public methods are thread-safe: calls from different tasks are serialized by the instance mutex
+// RU: Все публичные методы потокобезопасны: вызовы из разных задач упорядочиваются мьютексом экземпляра
 class reLCD {
   public:
     reLCD(i2c_port_t i2c_bus, uint8_t i2c_addr, uint8_t cols, uint8_t rows);
+    reLCD(const lcd_gpio_config_t* pins, uint8_t cols, uint8_t rows);
+    ~reLCD();
+    // EN: Must be called before init()
+    // RU: Должен быть вызван до init()
+    void setPinWriter(lcd_pin_writer_t writer, void* arg, lcd_pin_delay_t delay = nullptr);
     void begin(uint8_t cols, uint8_t rows, uint8_t charsize = LCD_5x8DOTS);
     void init();
     // EN: Clear display
     // RU: Очистка дисплея
     void clear();
     void clear(uint8_t rowStart, uint8_t colStart = 0, uint8_t colCnt = 255);
-    // EN: Move cursor
-    // RU: Перемещение курсора
+    // EN: Move cursor. The column may be beyond the visible ones, up to the end of the DDRAM row
+    // RU: Перемещение курсора. Столбец может быть за видимыми, до конца строки DDRAM
     void home();
     void setCursor(uint8_t col, uint8_t row); 
     // EN: Options
@@ -99,8 +269,11 @@ class reLCD {
     void setCursorVisible(bool enabled);
     void setRightToLeft(bool enabled);
     void setBacklight(bool enabled);
-    // EN: Scroll text
-    // RU: Прокрутка текста
+    // EN: Scroll text. With autoscroll every char written shifts the display, so chars are sent at once and in order,
+    //     bypassing the frame rate; cells redrawn for other reasons (CGRAM changes) wait until autoscroll is off
+    // RU: Прокрутка текста. При автопрокрутке каждый записанный символ сдвигает дисплей, поэтому символы отправляются сразу 
+    //     и по порядку, минуя ограничение частоты кадров; ячейки, перерисовываемые по другим причинам (изменения CGRAM), 
+    //     ждут отключения автопрокрутки
     void scrollDisplayLeft();
     void scrollDisplayRight();
     void setAutoscroll(bool enabled); 
@@ -111,12 +284,64 @@ class reLCD {
     uint8_t printpos(uint8_t col, uint8_t row, const char* text);
     uint8_t printf(const char* fmtstr, ...);
     uint8_t printn(uint8_t col, uint8_t row, uint8_t width, const char* fmtstr, ...);
-    // EN: Custom chars
-    // RU: Пользовательские символы
+    // EN: Text is collected in a frame buffer and sent no more than fps times per second (0 - immediately).
+    //     With a limited frame rate or a frame budget, call update() while isPending() to send deferred changes
+    // RU: Текст собирается в буфере кадра и отправляется не чаще fps раз в секунду (0 - сразу).
+    //     При ограниченной частоте кадров или бюджете кадра вызывайте update(), пока isPending(), для отправки отложенных изменений
+    void setFrameRate(uint8_t fps);
+    void setPriority(uint8_t col, uint8_t row, uint8_t width, lcd_priority_t priority);
+    bool update();
+    bool isPending();
+    // EN: Shared bus: bytes per I2C transaction with a pause between them, and bytes per frame (0 - unlimited).
+    //     The frame budget covers cells, CGRAM images of russian chars and animation frames; one image or cell may overrun it.
+    //     createChar() and commands are sent at once. On the parallel interface every command or char counts as one byte
+    // RU: Общая шина: байт на транзакцию I2C с паузой между ними и байт на кадр (0 - без ограничений).
+    //     Бюджет кадра охватывает ячейки, изображения русских символов в CGRAM и кадры анимаций; одно изображение или ячейка
+    //     может превысить его. createChar() и команды отправляются сразу. На параллельном интерфейсе каждая команда или 
+    //     символ считается одним байтом
+    void setBusSlice(uint16_t size, uint8_t gap_ms);
+    void setFrameBudget(uint16_t size);
+    // EN: Screen mirror: read-only access to the display contents without copying. 
+    //     getSequence() changes every time the contents or state change and is odd while they are being changed:
+    //     data read from another task is consistent if the sequence was even and the same before and after reading.
+    //     exportUTF8() and getState() are consistent by themselves. getScreenRow() returns the whole DDRAM row (width codes),
+    //     exportUTF8() the visible columns as shown with the display shift
+    // RU: Зеркало экрана: доступ только для чтения к содержимому дисплея без копирования. 
+    //     getSequence() изменяется при каждом изменении содержимого или состояния и нечетно, пока они изменяются:
+    //     данные, прочитанные из другой задачи, согласованы, если последовательность была четной и одинаковой до и после чтения.
+    //     exportUTF8() и getState() согласованы сами по себе. getScreenRow() возвращает всю строку DDRAM (width кодов),
+    //     exportUTF8() - видимые столбцы так, как они показаны со сдвигом дисплея
+    const uint8_t* getScreenRow(uint8_t row);
+    const uint8_t* getCGRAM();
+    void getState(lcd_state_t* state);
+    uint32_t getSequence();
+    size_t exportUTF8(uint8_t row, char* buf, size_t size);
+    #if CONFIG_LCD_STATS
+      // EN: Statistics
+      // RU: Статистика
+      void getStats(lcd_stats_t* stats);
+      void resetStats();
+    #endif // CONFIG_LCD_STATS
+    // EN: Custom chars. Locations filled by createChar() (and by init_bargraph()) are not used for russian chars
+    //     until releaseCustomChars()
+    // RU: Пользовательские символы. Ячейки, заполненные createChar() (и init_bargraph()), не используются для русских символов
+    //     до вызова releaseCustomChars()
     void createChar(uint8_t location, uint8_t charmap[]);
     #if LCD_RUS_USE_CUSTOM_CHARS
+      void releaseCustomChars();
       void resetRusCustomChars();
+      // EN: Substitutes for russian chars that did not fit into CGRAM (lcd_fallbacks_default by default)
+      // RU: Замены для русских символов, не поместившихся в CGRAM (по умолчанию lcd_fallbacks_default)
+      void setFallbacks(const lcd_fallback_t* fallbacks);
     #endif // LCD_RUS_USE_CUSTOM_CHARS
+    // EN: Animations: only the image in the CGRAM slot is rewritten, all cells showing it (write(location)) change at once.
+    //     Frames are changed by update(). stopAnimation() leaves the last frame in the slot and returns the slot to russian chars,
+    //     which may reuse it. createChar() on the location stops its animation
+    // RU: Анимации: перезаписывается только изображение в слоте CGRAM, все ячейки с ним (write(location)) меняются сразу.
+    //     Кадры сменяются в update(). stopAnimation() оставляет в слоте последний кадр и возвращает слот русским символам,
+    //     которые могут занять его. createChar() для этой ячейки останавливает ее анимацию
+    bool startAnimation(uint8_t location, const lcd_animation_t* animation);
+    void stopAnimation(uint8_t location);
     // EN: Bar graphs
     // RU: Гистограммы
     uint8_t init_bargraph(uint8_t graphtype);
@@ -129,6 +354,18 @@ class reLCD {
   private:
     i2c_port_t  _I2C_num;
     uint8_t     _I2C_addr;
+    bool        _parallel;
+    uint8_t     _bitmode;
+    lcd_gpio_config_t _gpio;
+    lcd_pin_writer_t  _pinWriter;
+    lcd_pin_delay_t   _pinDelay;
+    void*             _pinArg;
+    #if SOC_DEDICATED_GPIO_SUPPORTED
+      dedic_gpio_bundle_handle_t _bundle;
+      uint16_t    _bundlePins[SOC_DEDIC_GPIO_OUT_CHANNELS_NUM];
+      uint16_t    _bundleLines;
+      uint8_t     _bundleSize;
+    #endif // SOC_DEDICATED_GPIO_SUPPORTED
     uint8_t     _displayfunction;
     uint8_t     _displaycontrol;
     uint8_t     _displaymode;
@@ -138,19 +375,94 @@ class reLCD {
     uint8_t     _backlightval;
     uint8_t     _graphtype;
     uint8_t     _graphstate[20];
+    uint8_t     _col;
+    uint8_t     _row;
+    uint8_t     _shift;
+    uint8_t     _ddram;
+    uint8_t     _lineCols;
+    uint8_t     _frame[LCD_MAX_ROWS][LCD_DDRAM_COLS];
+    uint8_t     _shadow[LCD_MAX_ROWS][LCD_DDRAM_COLS];
+    uint8_t     _prio[LCD_MAX_ROWS][LCD_DDRAM_COLS];
+    uint64_t    _dirty[LCD_MAX_ROWS];
+    uint32_t    _frameInterval;
+    int64_t     _frameTime;
+    int64_t     _lowTime;
+    uint32_t    _busTime;
+    uint8_t     _cgram[MAX_CUSTOM_CHARS][LCD_CHARACTER_VERTICAL_DOTS];
+    uint8_t     _cgramValid;
+    uint8_t     _reserved;
+    const lcd_animation_t* _anim[MAX_CUSTOM_CHARS];
+    uint8_t     _animFrame[MAX_CUSTOM_CHARS];
+    int64_t     _animTime[MAX_CUSTOM_CHARS];
+    uint32_t    _sequence;
+    uint8_t     _seqDepth;
+    SemaphoreHandle_t _lock;
+    #if CONFIG_LCD_STATS
+      lcd_stats_t _stats;
+      int64_t     _dirtyTime;
+      void statLatency(uint32_t* histogram, int64_t start);
+    #endif // CONFIG_LCD_STATS
+    uint8_t     _txbuf[LCD_TX_BUFFERS][CONFIG_LCD_TX_BUFFER_SIZE];
+    uint16_t    _txlen[LCD_TX_BUFFERS];
+    uint8_t     _txcur;
+    uint8_t     _txdepth;
+    uint32_t    _txbytes;
+    uint16_t    _sliceSize;
+    uint8_t     _sliceGap;
+    uint16_t    _flushBudget;
+    uint8_t     _flushPos;
+    volatile bool _txfault;
+    #if CONFIG_LCD_TX_PIPELINE
+      uint8_t           _txsend;
+      TaskHandle_t      _txtask;
+      SemaphoreHandle_t _txidle;
+      static void txTask(void* arg);
+      void txStart();
+    #endif // CONFIG_LCD_TX_PIPELINE
+    void setup(uint8_t cols, uint8_t rows);
+    void lock();
+    void unlock();
+    void gpioStart();
+    void pinWrite(uint16_t mask, uint16_t value);
+    void gpioWrite(uint8_t lines, uint8_t data, uint16_t rs);
+    void gpioSend(uint8_t value, uint8_t mode);
+    void delayUs(uint32_t us);
+    void delayMs(uint32_t ms);
+    void txBegin();
+    void txEnd();
+    void txReserve(uint8_t size);
+    void txGap();
+    void txFlush();
+    void txWait();
+    void txDelay(uint32_t us);
+    void txSend(uint8_t* buf, uint16_t len);
+    void resync();
     void send(uint8_t value, uint8_t mode);
     void command(uint8_t value);
     void expanderWrite(uint8_t data);
     void write4bits(uint8_t data);
-    uint16_t writeChar(uint8_t value);
+    void putChar(uint8_t chr);
+    void putShifted(uint8_t chr);
+    uint8_t mapChar(uint8_t chr);
+    uint8_t printText(const char* text);
+    void commit();
+    bool nextFrame();
+    bool overBudget(uint32_t start);
+    void flush(uint8_t priority, uint32_t start);
+    void loadChar(uint8_t location, const uint8_t* charmap);
+    void animate(int64_t now, uint32_t start);
+    uint16_t codeToUnicode(uint8_t code);
+    void changeBegin();
+    void changeEnd();
     void pulseEnable(uint8_t data);
     uint8_t graphHorizontalChars(uint8_t rowPattern);
     uint8_t graphVerticalChars(uint8_t rowPattern);
     #if LCD_RUS_USE_CUSTOM_CHARS
-      uint8_t  _col;
-      uint8_t  _row;
-      uint8_t _buf_chars[MAX_CUSTOM_CHARS];
-      uint8_t writeRus(uint8_t chr);
+      lcd_cgram_plan_t _plan;
+      uint8_t     _userChars;
+      bool        _planPending;
+      void planFrame(uint32_t start);
+      void releaseSlot(uint8_t location);
     #endif // LCD_RUS_USE_CUSTOM_CHARS
 };
 
@@ -0,0 +1,72 @@
+/*
+   EN: CGRAM planner for russian chars on HD44780 displays without a russian character generator.
+       Does not depend on ESP-IDF and can also be used on the host, for example to check page templates at build time
+   RU: Планировщик CGRAM для русских символов на дисплеях HD44780 без русского знакогенератора.
+       Не зависит от ESP-IDF и может использоваться на хосте, например для проверки шаблонов страниц при сборке
+   --------------------------
+   (с) 2023 Разживин Александр | Razzhivin Alexander
+   kotyara12@yandex.ru | https://kotyara12.ru | tg: @kotyara1971
+   --------------------------
+   Страница проекта: https://github.com/kotyara12/reLCD
+*/
+
+#ifndef __RE_LCD_PLANNER_H__
+#define __RE_LCD_PLANNER_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// EN: Number of CGRAM locations
+// RU: Количество ячеек CGRAM
+#define LCD_PLAN_SLOTS 8
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// EN: Substitutes for a char that did not get a CGRAM location, in order of preference (0 - end of list)
+// RU: Замены для символа, не получившего ячейку CGRAM, в порядке предпочтения (0 - конец списка)
+typedef struct {
+  uint8_t chr;
+  uint8_t alt[3];
+} lcd_fallback_t;
+
+// EN: Default substitutes: the other case of the letter, then Latin or digit lookalike. The list ends with chr = 0
+// RU: Замены по умолчанию: буква в другом регистре, затем похожая латинская буква или цифра. Список заканчивается chr = 0
+extern const lcd_fallback_t lcd_fallbacks_default[];
+
+// EN: All chars are cp1251 codes, as they are stored in the frame buffer
+// RU: Все символы - коды cp1251, как они хранятся в буфере кадра
+typedef struct {
+  uint8_t count[128];                 // EN: usage of chars 0x80..0xFF which need an image / RU: использование символов 0x80..0xFF, которым нужно изображение
+  uint8_t slots[LCD_PLAN_SLOTS];      // EN: char loaded into each location, 0 - free / RU: символ, загруженный в каждую ячейку, 0 - свободна
+  uint8_t reserved;                   // EN: locations not available to the planner (bit mask) / RU: ячейки, недоступные планировщику (битовая маска)
+  const lcd_fallback_t* fallbacks;
+} lcd_cgram_plan_t;
+
+// EN: Display code of a char from the character generator ROM, 0 if an image in CGRAM is required (° is cp1251 0xB0)
+// RU: Код символа из ПЗУ знакогенератора, 0 если требуется изображение в CGRAM (° - это 0xB0 в cp1251)
+uint8_t lcdRomChar(uint8_t chr);
+// EN: Image of a russian char (8 rows), nullptr if there is none
+// RU: Изображение русского символа (8 строк), nullptr если его нет
+const uint8_t* lcdRusImage(uint8_t chr);
+// EN: Returns the cp1251 code of the UTF-8 char at text[*pos] and moves *pos to the next char
+// RU: Возвращает код cp1251 символа UTF-8 в text[*pos] и перемещает *pos на следующий символ
+uint8_t lcdDecodeUTF8(const char* text, size_t len, size_t* pos);
+
+// EN: Planning: lcdPlanInit() once, then for every frame lcdPlanBegin(), lcdPlanCount...() for all its text and lcdPlanSolve().
+//     lcdPlanSolve() returns the bit mask of locations whose images must be loaded, the frame is then drawn with lcdPlanResolve()
+// RU: Планирование: один раз lcdPlanInit(), затем для каждого кадра lcdPlanBegin(), lcdPlanCount...() для всего его текста и lcdPlanSolve().
+//     lcdPlanSolve() возвращает битовую маску ячеек, изображения которых нужно загрузить, затем кадр выводится через lcdPlanResolve()
+void lcdPlanInit(lcd_cgram_plan_t* plan, const lcd_fallback_t* fallbacks);
+void lcdPlanBegin(lcd_cgram_plan_t* plan, uint8_t reserved);
+void lcdPlanCount(lcd_cgram_plan_t* plan, const uint8_t* chars, size_t len);
+void lcdPlanCountUTF8(lcd_cgram_plan_t* plan, const char* text);
+uint8_t lcdPlanSolve(lcd_cgram_plan_t* plan);
+uint8_t lcdPlanResolve(const lcd_cgram_plan_t* plan, uint8_t chr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __RE_LCD_PLANNER_H__
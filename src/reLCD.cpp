@@ -6,6 +6,7 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include "esp_timer.h"
 #include "project_config.h"
 
 // Commands
@@ -29,74 +30,154 @@
 #define constrainb(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
 #define constrainh(amt,high) ((amt)>(high)?(high):(amt))
 
-#if LCD_RUS_USE_CUSTOM_CHARS
+#if CONFIG_LCD_STATS
+  #define LCD_STAT(field, value) _stats.field += (value)
+  #define LCD_LATENCY_BEGIN() int64_t _latency_start = esp_timer_get_time()
+  #define LCD_LATENCY_END(call) statLatency(_stats.latency[call], _latency_start)
+#else
+  // statements, so that "if (...) LCD_STAT(...);" does not leave an empty body
+  #define LCD_STAT(field, value) do {} while (0)
+  #define LCD_LATENCY_BEGIN() do {} while (0)
+  #define LCD_LATENCY_END(call) do {} while (0)
+#endif // CONFIG_LCD_STATS
+
+static const uint8_t row_offsets[LCD_MAX_ROWS] = { 0x00, 0x40, 0x14, 0x54 };
 
-typedef struct {
-  uint8_t rastr[8];   // Symbol bitmap
-  uint8_t charcode;   // Character code in unicode
-} image_char_t;
-
-// Russian symbols
-const image_char_t rus_chars[] = {
-  {{0b11111, 0b10000, 0b10000, 0b11110, 0b10001, 0b10001, 0b11110, 0b00000}, 193}, // 0x0411, 0xD091, 193 :: Б
-  {{0b11111, 0b10000, 0b10000, 0b10000, 0b10000, 0b10000, 0b10000, 0b00000}, 195}, // 0x0413, 0xD093, 195 :: Г
-  {{0b00110, 0b01010, 0b01010, 0b01010, 0b01010, 0b01010, 0b11111, 0b10001}, 196}, // 0x0414, 0xD094, 196 :: Д
-  {{0b10101, 0b10101, 0b10101, 0b01110, 0b10101, 0b10101, 0b10101, 0b00000}, 198}, // 0x0416, 0xD096, 198 :: Ж
-  {{0b01110, 0b10001, 0b00001, 0b00110, 0b00001, 0b10001, 0b01110, 0b00000}, 199}, // 0x0417, 0xD097, 199 :: З
-  {{0b10001, 0b10001, 0b10001, 0b10011, 0b10101, 0b11001, 0b10001, 0b00000}, 200}, // 0x0418, 0xD098, 200 :: И
-  {{0b10101, 0b10001, 0b10001, 0b10011, 0b10101, 0b11001, 0b10001, 0b00000}, 201}, // 0x0419, 0xD099, 201 :: Й
-  {{0b00111, 0b01001, 0b01001, 0b01001, 0b01001, 0b01001, 0b10001, 0b00000}, 203}, // 0x041B, 0xD09B, 203 :: Л
-  {{0b11111, 0b10001, 0b10001, 0b10001, 0b10001, 0b10001, 0b10001, 0b00000}, 207}, // 0x041F, 0xD09F, 207 :: П
-  {{0b10001, 0b10001, 0b10001, 0b01111, 0b00001, 0b10001, 0b01110, 0b00000}, 211}, // 0x0423, 0xD0A3, 211 :: У
-  {{0b00100, 0b01110, 0b10101, 0b10101, 0b10101, 0b01110, 0b00100, 0b00000}, 212}, // 0x0424, 0xD0A4, 212 :: Ф
-  {{0b10010, 0b10010, 0b10010, 0b10010, 0b10010, 0b10010, 0b11111, 0b00001}, 214}, // 0x0426, 0xD0A6, 214 :: Ц
-  {{0b10001, 0b10001, 0b10001, 0b01111, 0b00001, 0b00001, 0b00001, 0b00000}, 215}, // 0x0427, 0xD0A7, 215 :: Ч
-  {{0b10001, 0b10001, 0b10001, 0b10101, 0b10101, 0b10101, 0b11111, 0b00000}, 216}, // 0x0428, 0xD0A8, 216 :: Ш
-  {{0b10001, 0b10001, 0b10001, 0b10101, 0b10101, 0b10101, 0b11111, 0b00001}, 217}, // 0x0429, 0xD0A9, 217 :: Щ
-  {{0b11000, 0b01000, 0b01000, 0b01110, 0b01001, 0b01001, 0b01110, 0b00000}, 218}, // 0x042A, 0xD0AA, 218 :: Ъ
-  {{0b10001, 0b10001, 0b10001, 0b11101, 0b10011, 0b10011, 0b11101, 0b00000}, 219}, // 0x042B, 0xD0AB, 219 :: Ы
-  {{0b10000, 0b10000, 0b10000, 0b11110, 0b10001, 0b10001, 0b11110, 0b00000}, 220}, // 0x042C, 0xD0AC, 220 :: Ь
-  {{0b01110, 0b10001, 0b00001, 0b00111, 0b00001, 0b10001, 0b01110, 0b00000}, 221}, // 0x042D, 0xD0AD, 221 :: Э
-  {{0b10010, 0b10101, 0b10101, 0b11101, 0b10101, 0b10101, 0b10010, 0b00000}, 222}, // 0x042E, 0xD0AE, 222 :: Ю
-  {{0b01111, 0b10001, 0b10001, 0b01111, 0b00101, 0b01001, 0b10001, 0b00000}, 223}, // 0x042F, 0xD0AF, 223 :: Я
-  {{0b00011, 0b01100, 0b10000, 0b11110, 0b10001, 0b10001, 0b01110, 0b00000}, 225}, // 0x0431, 0xD0B1, 225 :: б
-  {{0b00000, 0b00000, 0b11110, 0b10001, 0b11110, 0b10001, 0b11110, 0b00000}, 226}, // 0x0432, 0xD0B2, 226 :: в
-  {{0b00000, 0b00000, 0b11110, 0b10000, 0b10000, 0b10000, 0b10000, 0b00000}, 227}, // 0x0433, 0xD0B3, 227 :: г
-  {{0b00000, 0b00000, 0b00110, 0b01010, 0b01010, 0b01010, 0b11111, 0b10001}, 228}, // 0x0434, 0xD0B4, 228 :: д
-  {{0b01010, 0b00000, 0b01110, 0b10001, 0b11111, 0b10000, 0b01111, 0b00000}, 184}, // 0x0451, 0xD191, 184 :: ё
-  {{0b00000, 0b00000, 0b10101, 0b10101, 0b01110, 0b10101, 0b10101, 0b00000}, 230}, // 0x0436, 0xD0B6, 230 :: ж
-  {{0b00000, 0b00000, 0b01110, 0b10001, 0b00110, 0b10001, 0b01110, 0b00000}, 231}, // 0x0437, 0xD0B7, 231 :: з
-  {{0b00000, 0b00000, 0b10001, 0b10011, 0b10101, 0b11001, 0b10001, 0b00000}, 232}, // 0x0438, 0xD0B8, 232 :: и
-  {{0b01010, 0b00100, 0b10001, 0b10011, 0b10101, 0b11001, 0b10001, 0b00000}, 233}, // 0x0439, 0xD0B9, 233 :: й
-  {{0b00000, 0b00000, 0b10010, 0b10100, 0b11000, 0b10100, 0b10010, 0b00000}, 234}, // 0x043A, 0xD0BA, 234 :: к
-  {{0b00000, 0b00000, 0b00111, 0b01001, 0b01001, 0b01001, 0b10001, 0b00000}, 235}, // 0x043B, 0xD0BB, 235 :: л
-  {{0b00000, 0b00000, 0b10001, 0b11011, 0b10101, 0b10001, 0b10001, 0b00000}, 236}, // 0x043C, 0xD0BC, 236 :: м
-  {{0b00000, 0b00000, 0b10001, 0b10001, 0b11111, 0b10001, 0b10001, 0b00000}, 237}, // 0x043D, 0xD0BD, 237 :: н
-  {{0b00000, 0b00000, 0b11111, 0b10001, 0b10001, 0b10001, 0b10001, 0b00000}, 239}, // 0x043F, 0xD0BF, 239 :: п
-  {{0b00000, 0b00000, 0b11111, 0b00100, 0b00100, 0b00100, 0b00100, 0b00000}, 242}, // 0x0442, 0xD182, 242 :: т
-  {{0b00000, 0b00000, 0b00100, 0b01110, 0b10101, 0b01110, 0b00100, 0b00000}, 244}, // 0x0444, 0xD184, 244 :: ф
-  {{0b00000, 0b00000, 0b10010, 0b10010, 0b10010, 0b10010, 0b11111, 0b00001}, 246}, // 0x0446, 0xD186, 246 :: ц
-  {{0b00000, 0b00000, 0b10001, 0b10001, 0b01111, 0b00001, 0b00001, 0b00000}, 247}, // 0x0447, 0xD187, 247 :: ч
-  {{0b00000, 0b00000, 0b10101, 0b10101, 0b10101, 0b10101, 0b11111, 0b00000}, 248}, // 0x0448, 0xD188, 248 :: ш
-  {{0b00000, 0b00000, 0b10101, 0b10101, 0b10101, 0b10101, 0b11111, 0b00001}, 249}, // 0x0449, 0xD189, 249 :: щ
-  {{0b00000, 0b00000, 0b11000, 0b01000, 0b01110, 0b01001, 0b01110, 0b00000}, 250}, // 0x044A, 0xD18A, 250 :: ъ
-  {{0b00000, 0b00000, 0b10001, 0b10001, 0b11101, 0b10011, 0b11101, 0b00000}, 251}, // 0x044B, 0xD18B, 251 :: ы
-  {{0b00000, 0b00000, 0b10000, 0b10000, 0b11110, 0b10001, 0b11110, 0b00000}, 252}, // 0x044C, 0xD18C, 252 :: ь
-  {{0b00000, 0b00000, 0b01110, 0b10001, 0b00111, 0b10001, 0b01110, 0b00000}, 253}, // 0x044D, 0xD18D, 253 :: э
-  {{0b00000, 0b00000, 0b10010, 0b10101, 0b11101, 0b10101, 0b10010, 0b00000}, 254}, // 0x044E, 0xD18E, 254 :: ю
-  {{0b00000, 0b00000, 0b01111, 0b10001, 0b01111, 0b00101, 0b01001, 0b00000}, 255}  // 0x044F, 0xD18F, 255 :: я
+// Built-in animations
+static const uint8_t anim_spinner_frames[][LCD_CHARACTER_VERTICAL_DOTS] = {
+  {0b00100, 0b00100, 0b00100, 0b00100, 0b00100, 0b00100, 0b00100, 0b00000}, // |
+  {0b00001, 0b00010, 0b00010, 0b00100, 0b01000, 0b01000, 0b10000, 0b00000}, // /
+  {0b00000, 0b00000, 0b00000, 0b11111, 0b00000, 0b00000, 0b00000, 0b00000}, // -
+  {0b10000, 0b01000, 0b01000, 0b00100, 0b00010, 0b00010, 0b00001, 0b00000}  // backslash
+};
+static const uint8_t anim_wifi_frames[][LCD_CHARACTER_VERTICAL_DOTS] = {
+  {0b00000, 0b00000, 0b00000, 0b00000, 0b00000, 0b00000, 0b00000, 0b00000},
+  {0b00000, 0b00000, 0b00000, 0b00000, 0b00000, 0b00000, 0b01000, 0b01000},
+  {0b00000, 0b00000, 0b00000, 0b00000, 0b00100, 0b00100, 0b01100, 0b01100},
+  {0b00000, 0b00000, 0b00010, 0b00010, 0b00110, 0b00110, 0b01110, 0b01110},
+  {0b00001, 0b00001, 0b00011, 0b00011, 0b00111, 0b00111, 0b01111, 0b01111}
+};
+static const uint8_t anim_battery_frames[][LCD_CHARACTER_VERTICAL_DOTS] = {
+  {0b01110, 0b11111, 0b10001, 0b10001, 0b10001, 0b10001, 0b10001, 0b11111},
+  {0b01110, 0b11111, 0b10001, 0b10001, 0b10001, 0b10001, 0b11111, 0b11111},
+  {0b01110, 0b11111, 0b10001, 0b10001, 0b10001, 0b11111, 0b11111, 0b11111},
+  {0b01110, 0b11111, 0b10001, 0b10001, 0b11111, 0b11111, 0b11111, 0b11111},
+  {0b01110, 0b11111, 0b10001, 0b11111, 0b11111, 0b11111, 0b11111, 0b11111},
+  {0b01110, 0b11111, 0b11111, 0b11111, 0b11111, 0b11111, 0b11111, 0b11111}
 };
-const uint8_t count_images = sizeof(rus_chars) / sizeof(image_char_t);
 
-#endif // LCD_RUS_USE_CUSTOM_CHARS
+const lcd_animation_t lcd_anim_spinner = { anim_spinner_frames, sizeof(anim_spinner_frames) / LCD_CHARACTER_VERTICAL_DOTS, 150 };
+const lcd_animation_t lcd_anim_wifi    = { anim_wifi_frames,    sizeof(anim_wifi_frames)    / LCD_CHARACTER_VERTICAL_DOTS, 500 };
+const lcd_animation_t lcd_anim_battery = { anim_battery_frames, sizeof(anim_battery_frames) / LCD_CHARACTER_VERTICAL_DOTS, 500 };
+
 
 reLCD::reLCD(i2c_port_t i2c_bus, uint8_t i2c_addr, uint8_t cols, uint8_t rows)
 {
   _I2C_num = i2c_bus;
   _I2C_addr = i2c_addr;
-  _cols = cols;
-  _rows = rows;
+  _parallel = false;
+  _bitmode = LCD_4BITMODE;
+  setup(cols, rows);
+}
+
+reLCD::reLCD(const lcd_gpio_config_t* pins, uint8_t cols, uint8_t rows)
+{
+  _I2C_num = I2C_NUM_0;
+  _I2C_addr = 0;
+  _parallel = true;
+  _gpio = *pins;
+  _bitmode = pins->bitmode & LCD_8BITMODE;
+  setup(cols, rows);
+}
+
+// The transmit task must not outlive the object whose buffers it sends
+reLCD::~reLCD()
+{
+  #if CONFIG_LCD_TX_PIPELINE
+    if (_txtask) {
+      txFlush();
+      txWait();
+      vTaskDelete(_txtask);
+      _txtask = nullptr;
+    };
+    if (_txidle) {
+      vSemaphoreDelete(_txidle);
+      _txidle = nullptr;
+    };
+  #endif // CONFIG_LCD_TX_PIPELINE
+  #if SOC_DEDICATED_GPIO_SUPPORTED
+    if (_bundle) {
+      dedic_gpio_del_bundle(_bundle);
+      _bundle = nullptr;
+    };
+  #endif // SOC_DEDICATED_GPIO_SUPPORTED
+  if (_lock) {
+    vSemaphoreDelete(_lock);
+    _lock = nullptr;
+  };
+}
+
+void reLCD::setup(uint8_t cols, uint8_t rows)
+{
+  _lock = xSemaphoreCreateRecursiveMutex();
+  _cols = constrainb(cols, 1, LCD_MAX_COLS);
+  _rows = constrainb(rows, 1, LCD_MAX_ROWS);
+  // 4 row displays split each 40 char line of DDRAM into two rows
+  _lineCols = _rows > 2 ? LCD_DDRAM_COLS / 2 : LCD_DDRAM_COLS;
   _backlightval = LCD_NOBACKLIGHT;
+  _displaycontrol = LCD_DISPLAYON | LCD_CURSOROFF | LCD_BLINKOFF;
+  _displaymode = LCD_ENTRYLEFT | LCD_ENTRYSHIFTDECREMENT;
+  _col = 0;
+  _row = 0;
+  _shift = 0;
+  _ddram = 0xFF;
+  memset(_frame, ' ', sizeof(_frame));
+  memset(_shadow, ' ', sizeof(_shadow));
+  memset(_prio, LCD_PRIORITY_NORMAL, sizeof(_prio));
+  memset(_dirty, 0, sizeof(_dirty));
+  _frameInterval = 0;
+  _frameTime = 0;
+  _lowTime = 0;
+  _busTime = 0;
+  _txlen[0] = 0;
+  _txcur = 0;
+  _txdepth = 0;
+  _txbytes = 0;
+  _sliceSize = CONFIG_LCD_TX_BUFFER_SIZE;
+  _sliceGap = 0;
+  _flushBudget = 0;
+  _flushPos = 0;
+  _txfault = false;
+  _reserved = 0;
+  _cgramValid = 0;
+  memset(_cgram, 0, sizeof(_cgram));
+  _sequence = 0;
+  _seqDepth = 0;
+  for (uint8_t i = 0; i < MAX_CUSTOM_CHARS; i++) {
+    _anim[i] = nullptr;
+  };
+  _pinWriter = nullptr;
+  _pinDelay = nullptr;
+  _pinArg = nullptr;
+  #if LCD_RUS_USE_CUSTOM_CHARS
+    lcdPlanInit(&_plan, lcd_fallbacks_default);
+    _userChars = 0;
+    _planPending = false;
+  #endif // LCD_RUS_USE_CUSTOM_CHARS
+  #if CONFIG_LCD_STATS
+    resetStats();
+  #endif // CONFIG_LCD_STATS
+  #if SOC_DEDICATED_GPIO_SUPPORTED
+    _bundle = nullptr;
+    _bundleSize = 0;
+    _bundleLines = 0;
+  #endif // SOC_DEDICATED_GPIO_SUPPORTED
+  #if CONFIG_LCD_TX_PIPELINE
+    _txlen[1] = 0;
+    _txsend = 0;
+    _txtask = nullptr;
+    _txidle = nullptr;
+  #endif // CONFIG_LCD_TX_PIPELINE
   #if LCD_RUS_USE_CUSTOM_CHARS
     resetRusCustomChars();
   #endif // LCD_RUS_USE_CUSTOM_CHARS
@@ -104,12 +185,15 @@ reLCD::reLCD(i2c_port_t i2c_bus, uint8_t i2c_addr, uint8_t cols, uint8_t rows)
 
 void reLCD::init()
 {
-	_displayfunction = LCD_4BITMODE | LCD_1LINE | LCD_5x8DOTS;
+  lock();
+	_displayfunction = _bitmode | LCD_1LINE | LCD_5x8DOTS;
 	begin(_cols, _rows, LCD_5x8DOTS);  
+  unlock();
 }
 
 void reLCD::begin(uint8_t cols, uint8_t lines, uint8_t charsize) 
 {
+  lock();
 	if (lines > 1) {
 		_displayfunction |= LCD_2LINE;
 	}
@@ -120,32 +204,46 @@ void reLCD::begin(uint8_t cols, uint8_t lines, uint8_t charsize)
 		_displayfunction |= LCD_5x10DOTS;
 	}
 
+  if (_parallel) {
+    gpioStart();
+  };
+  #if CONFIG_LCD_TX_PIPELINE
+    if (!_parallel) txStart();
+  #endif // CONFIG_LCD_TX_PIPELINE
+  // CGRAM contents are unknown after power on
+  _cgramValid = 0;
+  _txfault = false;
+
 	// SEE PAGE 45/46 FOR INITIALIZATION SPECIFICATION!
 	// according to datasheet, we need at least 40ms after power rises above 2.7V before sending commands. 
-  ets_delay_us(50000);
+  delayUs(50000);
   
 	// Now we pull both RS and R/W low to begin commands
 	expanderWrite(_backlightval);	// reset expanderand turn backlight off (Bit 8 =1)
-  vTaskDelay(pdMS_TO_TICKS(100));
+  txWait();
+  delayMs(100);
 
   // put the LCD into 4 bit mode
 	// this is according to the hitachi HD44780 datasheet (figure 24, pg 46)
 	
   // we start in 8bit mode, try to set 4 bit mode
 	write4bits(0x30);
-  vTaskDelay(pdMS_TO_TICKS(5));
-	ets_delay_us(4500); // wait min 4.1ms
+  txWait();
+  delayMs(5);
+	txDelay(4500); // wait min 4.1ms
 	
 	// second try
 	write4bits(0x30);
-	ets_delay_us(4500); // wait min 4.1ms
+	txDelay(4500); // wait min 4.1ms
 	
 	// third go!
 	write4bits(0x30); 
-	ets_delay_us(150);
+	txDelay(150);
 	
 	// finally, set to 4-bit interface
-	write4bits(0x20); 
+  if (!(_displayfunction & LCD_8BITMODE)) {
+	  write4bits(0x20); 
+  };
 
 	// set # lines, font size, etc.
 	command(LCD_FUNCTIONSET | _displayfunction);  
@@ -164,119 +262,295 @@ void reLCD::begin(uint8_t cols, uint8_t lines, uint8_t charsize)
 	command(LCD_ENTRYMODESET | _displaymode);
 	
 	home();
+  unlock();
 }
 
 void reLCD::clear()
 {
+  LCD_LATENCY_BEGIN();
+  lock();
+  changeBegin();
   // clear display, set cursor position to zero
 	command(LCD_CLEARDISPLAY);  
   // this command takes a long time!
-	ets_delay_us(2000);
-  // reset cursor position
+	txDelay(2000);
+  // reset cursor position, display shift and frame buffer
+  _col = 0; _row = 0;
+  _shift = 0;
+  _ddram = 0;
+  memset(_frame, ' ', sizeof(_frame));
+  memset(_shadow, ' ', sizeof(_shadow));
+  memset(_dirty, 0, sizeof(_dirty));
+  #if CONFIG_LCD_STATS
+    _dirtyTime = 0;
+  #endif // CONFIG_LCD_STATS
   #if LCD_RUS_USE_CUSTOM_CHARS
-    _col = 0; _row = 0;
     resetRusCustomChars();
   #endif // LCD_RUS_USE_CUSTOM_CHARS
+  changeEnd();
+  LCD_LATENCY_END(LCD_CALL_CLEAR);
+  unlock();
 }
 
 // Clear particular segment of a row
 void reLCD::clear(uint8_t rowStart, uint8_t colStart, uint8_t colCnt) 
 {
+  LCD_LATENCY_BEGIN();
+  lock();
   // Maintain input parameters
   rowStart = constrainh(rowStart, _rows - 1);
-  colStart = constrainh(colStart, _cols - 1);
-  colCnt   = constrainh(colCnt,   _cols - colStart);
+  colStart = constrainh(colStart, _lineCols - 1);
+  colCnt   = constrainh(colCnt,   _lineCols - colStart);
+  changeBegin();
   // Clear segment
-  setCursor(colStart, rowStart);
-  for (uint8_t i = 0; i < colCnt; i++) write(' ');
+  _col = colStart; _row = rowStart;
+  for (uint8_t i = 0; i < colCnt; i++) putChar(' ');
   // Go to segment start
-  setCursor(colStart, rowStart);
+  _col = colStart; _row = rowStart;
+  changeEnd();
+  commit();
+  LCD_LATENCY_END(LCD_CALL_CLEAR);
+  unlock();
 }
 
 void reLCD::home()
 {
+  LCD_LATENCY_BEGIN();
+  lock();
+  changeBegin();
   // set cursor position to zero
 	command(LCD_RETURNHOME);  
   // this command takes a long time!
-	ets_delay_us(2000);
-  // reset cursor position
-  #if LCD_RUS_USE_CUSTOM_CHARS
-    _col = 0; _row = 0;
-  #endif // LCD_RUS_USE_CUSTOM_CHARS
+	txDelay(2000);
+  // reset cursor position and display shift
+  _col = 0; _row = 0;
+  _shift = 0;
+  _ddram = 0;
+  changeEnd();
+  LCD_LATENCY_END(LCD_CALL_HOME);
+  unlock();
 }
 
+// Only moves the position in the frame buffer, the display cursor follows on the next frame
 void reLCD::setCursor(uint8_t col, uint8_t row)
 {
-	int row_offsets[] = { 0x00, 0x40, 0x14, 0x54 };
-	if ( row > _numlines ) {
-		row = _numlines-1;    // we count rows starting w/0
-	}
-  #if LCD_RUS_USE_CUSTOM_CHARS
-  _col = col; _row = row;
-  #endif // LCD_RUS_USE_CUSTOM_CHARS
-	command(LCD_SETDDRAMADDR | (col + row_offsets[row]));
+  LCD_LATENCY_BEGIN();
+  lock();
+  changeBegin();
+  _col = constrainh(col, _lineCols - 1);
+  _row = constrainh(row, _rows - 1);    // we count rows starting w/0
+  changeEnd();
+  commit();
+  LCD_LATENCY_END(LCD_CALL_COMMAND);
+  unlock();
 }
 
 // Turn the display on/off (quickly)
 void reLCD::setDisplay(bool enabled) 
 {
+  LCD_LATENCY_BEGIN();
+  lock();
+  changeBegin();
   enabled ? _displaycontrol |= LCD_DISPLAYON : _displaycontrol &= ~LCD_DISPLAYON;
 	command(LCD_DISPLAYCONTROL | _displaycontrol);
+  changeEnd();
+  LCD_LATENCY_END(LCD_CALL_COMMAND);
+  unlock();
 }
 
 // Turns the underline cursor on/off
 void reLCD::setCursorVisible(bool enabled) 
 {
+  LCD_LATENCY_BEGIN();
+  lock();
+  changeBegin();
   enabled ? _displaycontrol |= LCD_CURSORON : _displaycontrol &= ~LCD_CURSORON;
 	command(LCD_DISPLAYCONTROL | _displaycontrol);
+  changeEnd();
+  commit();
+  LCD_LATENCY_END(LCD_CALL_COMMAND);
+  unlock();
 }
 
 // Turn on and off the blinking cursor
 void reLCD::setBlink(bool enabled) 
 {
+  LCD_LATENCY_BEGIN();
+  lock();
+  changeBegin();
   enabled ? _displaycontrol |= LCD_BLINKON : _displaycontrol &= ~LCD_BLINKON;
 	command(LCD_DISPLAYCONTROL | _displaycontrol);
+  changeEnd();
+  commit();
+  LCD_LATENCY_END(LCD_CALL_COMMAND);
+  unlock();
 }
 
 // Turn the (optional) backlight off/on
 void reLCD::setBacklight(bool enabled) {
+  LCD_LATENCY_BEGIN();
+  lock();
+  changeBegin();
 	enabled ? _backlightval = LCD_BACKLIGHT : _backlightval = LCD_NOBACKLIGHT;
-	expanderWrite(0);
+  if (_parallel) {
+    pinWrite(LCD_PIN_BL, enabled ? LCD_PIN_BL : 0);
+  } else {
+	  expanderWrite(0);
+  };
+  changeEnd();
+  LCD_LATENCY_END(LCD_CALL_COMMAND);
+  unlock();
 }
 
 // This is for text that flows Left to Right
 void reLCD::setRightToLeft(bool enabled)
 {
+  LCD_LATENCY_BEGIN();
+  lock();
+  changeBegin();
   enabled ? _displaymode &= ~LCD_ENTRYLEFT : _displaymode |= LCD_ENTRYLEFT;
 	command(LCD_ENTRYMODESET | _displaymode);
+  changeEnd();
+  LCD_LATENCY_END(LCD_CALL_COMMAND);
+  unlock();
 }
 
 // This will 'right justify' text from the cursor
 void reLCD::setAutoscroll(bool enabled) 
 {
+  LCD_LATENCY_BEGIN();
+  lock();
+  if (enabled) {
+    // Changes collected so far are drawn before the display starts to shift
+    uint16_t budget = _flushBudget;
+    _flushBudget = 0;
+    flush(LCD_PRIORITY_LOW, _txbytes);
+    _flushBudget = budget;
+  };
+  changeBegin();
   enabled ? _displaymode |= LCD_ENTRYSHIFTINCREMENT : _displaymode &= ~LCD_ENTRYSHIFTINCREMENT;
 	command(LCD_ENTRYMODESET | _displaymode);
+  changeEnd();
+  if (!enabled) commit();
+  LCD_LATENCY_END(LCD_CALL_COMMAND);
+  unlock();
 }
 
 // These commands scroll the display without changing the RAM
 void reLCD::scrollDisplayLeft(void) 
 {
+  LCD_LATENCY_BEGIN();
+  lock();
+  changeBegin();
 	command(LCD_CURSORSHIFT | LCD_DISPLAYMOVE | LCD_MOVELEFT);
+  _shift = (_shift + 1) % LCD_DDRAM_COLS;
+  changeEnd();
+  LCD_LATENCY_END(LCD_CALL_COMMAND);
+  unlock();
 }
 
 void reLCD::scrollDisplayRight(void) 
 {
+  LCD_LATENCY_BEGIN();
+  lock();
+  changeBegin();
 	command(LCD_CURSORSHIFT | LCD_DISPLAYMOVE | LCD_MOVERIGHT);
+  _shift = (_shift + LCD_DDRAM_COLS - 1) % LCD_DDRAM_COLS;
+  changeEnd();
+  LCD_LATENCY_END(LCD_CALL_COMMAND);
+  unlock();
 }
 
 // Allows us to fill the first 8 CGRAM locations with custom characters
 void reLCD::createChar(uint8_t location, uint8_t charmap[]) 
+{
+  LCD_LATENCY_BEGIN();
+  lock();
+  // The image of the application replaces the animation
+  _anim[location & 0x7] = nullptr;
+  _reserved &= ~(1 << (location & 0x7));
+  #if LCD_RUS_USE_CUSTOM_CHARS
+    // The location belongs to the application until releaseCustomChars()
+    releaseSlot(location & 0x7);
+    _userChars |= (1 << (location & 0x7));
+  #endif // LCD_RUS_USE_CUSTOM_CHARS
+  loadChar(location, charmap);
+  LCD_LATENCY_END(LCD_CALL_CREATECHAR);
+  unlock();
+}
+
+// Only the rows that differ from the current CGRAM contents are sent
+void reLCD::loadChar(uint8_t location, const uint8_t* charmap)
 {
 	location &= 0x7; // we only have 8 locations 0-7
-	command(LCD_SETCGRAMADDR | (location << 3));
-	for (int i=0; i<8; i++) {
-		write(charmap[i]);
+  bool known = _cgramValid & (1 << location);
+  uint8_t next = 0xFF;
+  txBegin();
+	for (uint8_t i = 0; i < LCD_CHARACTER_VERTICAL_DOTS; i++) {
+    if (known && (_cgram[location][i] == charmap[i])) continue;
+    if (next != i) {
+      if (next == 0xFF) {
+        changeBegin();
+        LCD_STAT(cgram_uploads, 1);
+      };
+      command(LCD_SETCGRAMADDR | (location << 3) | i);
+    };
+		send(charmap[i], Rs);
+    _cgram[location][i] = charmap[i];
+    next = i + 1;
 	}
+  txEnd();
+  _cgramValid |= (1 << location);
+  // address counter now points to CGRAM
+  if (next != 0xFF) {
+    _ddram = 0xFF;
+    changeEnd();
+  };
+}
+
+/*********** animations ***********/
+
+// The slot is excluded from russian chars, cells showing it are animated by rewriting the image only
+bool reLCD::startAnimation(uint8_t location, const lcd_animation_t* animation)
+{
+  if ((location >= MAX_CUSTOM_CHARS) || (animation == nullptr) || (animation->count == 0)) return false;
+  LCD_LATENCY_BEGIN();
+  lock();
+  #if LCD_RUS_USE_CUSTOM_CHARS
+    releaseSlot(location);
+  #endif // LCD_RUS_USE_CUSTOM_CHARS
+  _reserved |= (1 << location);
+  _anim[location] = animation;
+  _animFrame[location] = 0;
+  _animTime[location] = esp_timer_get_time() + (int64_t)animation->interval_ms * 1000;
+  loadChar(location, animation->frames[0]);
+  commit();
+  LCD_LATENCY_END(LCD_CALL_CREATECHAR);
+  unlock();
+  return true;
+}
+
+void reLCD::stopAnimation(uint8_t location)
+{
+  if (location >= MAX_CUSTOM_CHARS) return;
+  lock();
+  _anim[location] = nullptr;
+  _reserved &= ~(1 << location);
+  unlock();
+}
+
+// Frames that do not fit into the frame budget are shown by the following frames
+void reLCD::animate(int64_t now, uint32_t start)
+{
+  for (uint8_t i = 0; i < MAX_CUSTOM_CHARS; i++) {
+    if (_anim[i] && (now >= _animTime[i])) {
+      if (overBudget(start)) break;
+      _animFrame[i]++;
+      if (_animFrame[i] >= _anim[i]->count) _animFrame[i] = 0;
+      loadChar(i, _anim[i]->frames[_animFrame[i]]);
+      _animTime[i] = now + (int64_t)_anim[i]->interval_ms * 1000;
+    };
+  };
 }
 
 /*********** mid level commands, for sending data/cmds ***********/
@@ -286,153 +560,207 @@ inline void reLCD::command(uint8_t value)
 	send(value, 0);
 }
 
-uint16_t reLCD::writeChar(uint8_t value) 
+// Put a character into the frame buffer, it will be sent to the display with the next frame.
+// The position moves in the entry direction through the whole DDRAM row, as the address counter of the display does
+void reLCD::putChar(uint8_t chr) 
 {
-	send(value, Rs);
-  #if LCD_RUS_USE_CUSTOM_CHARS
+  if (_displaymode & LCD_ENTRYSHIFTINCREMENT) {
+    putShifted(chr);
+  } else if (_frame[_row][_col] != chr) {
+    #if CONFIG_LCD_STATS
+      if (_dirtyTime == 0) _dirtyTime = esp_timer_get_time();
+    #endif // CONFIG_LCD_STATS
+    _frame[_row][_col] = chr;
+    _dirty[_row] |= (1ULL << _col);
+  };
+  if (_displaymode & LCD_ENTRYLEFT) {
     _col++;
-    if (_col >= _cols) {
-      _col =0;
-      _row++;
-      if (_row >= _rows) {
-        _row = 0;
-      };
+    if (_col >= _lineCols) {
+      _col = 0;
+      _row = _row + 1 < _rows ? _row + 1 : 0;
+    };
+  } else {
+    if (_col == 0) {
+      _col = _lineCols;
+      _row = _row > 0 ? _row - 1 : _rows - 1;
     };
+    _col--;
+  };
+}
+
+// Every char written with autoscroll shifts the display: it is sent at once, even if the cell already shows it
+void reLCD::putShifted(uint8_t chr)
+{
+  changeBegin();
+  txBegin();
+  _frame[_row][_col] = chr;
+  #if LCD_RUS_USE_CUSTOM_CHARS
+    planFrame(_txbytes);
   #endif // LCD_RUS_USE_CUSTOM_CHARS
-	return 1;
+  _dirty[_row] &= ~(1ULL << _col);
+  uint8_t code = mapChar(chr);
+  uint8_t addr = row_offsets[_row] + _col;
+  if (_ddram != addr) {
+    command(LCD_SETDDRAMADDR | addr);
+  };
+  send(code, Rs);
+  LCD_STAT(cells_sent, 1);
+  _shadow[_row][_col] = code;
+  if (_displaymode & LCD_ENTRYLEFT) {
+    _ddram = addr + 1;
+    _shift = (_shift + 1) % LCD_DDRAM_COLS;
+  } else {
+    _ddram = addr - 1;
+    _shift = (_shift + LCD_DDRAM_COLS - 1) % LCD_DDRAM_COLS;
+  };
+  txEnd();
+  changeEnd();
 }
 
 #if LCD_RUS_USE_CUSTOM_CHARS
 
 void reLCD::resetRusCustomChars()
 {
+  lock();
   for (uint8_t j = 0; j < MAX_CUSTOM_CHARS; j++) {
-    _buf_chars[j] = 0;
+    _plan.slots[j] = 0;
   };
+  unlock();
 }
 
-uint8_t reLCD::writeRus(uint8_t chr)
+// Locations filled by createChar() are returned to russian chars
+void reLCD::releaseCustomChars()
 {
-  // Scan in buffer
-  for (uint8_t i = 0; i < MAX_CUSTOM_CHARS; i++) {
-    if (_buf_chars[i] == chr) {
-      return writeChar(i);
-    };
-  };
+  lock();
+  _userChars = 0;
+  unlock();
+}
 
-  // Find symbol in images
-  for (uint8_t i = 0; i < count_images; i++) {
-    if (rus_chars[i].charcode == chr) {
-      uint8_t col = _col;
-      uint8_t row = _row;
-      // Searching for a blank character
-      uint8_t index = 255;
-      for (uint8_t j = 0; j < MAX_CUSTOM_CHARS; j++) {
-        if (_buf_chars[j] == 0) {
-          index = j;
-          break;
-        };
-      };
-      // All buffers are busy - reset all
-      if (index == 255) {
-        index = 0;
-        resetRusCustomChars();
-      };
-      // Create new custom char
-      _buf_chars[index] = chr;
-      createChar(index, (uint8_t*)(rus_chars[i].rastr));
-      // Print custom char
-      setCursor(col, row);
-      return writeChar(index);
+// Cells showing a russian char from this location must receive another location or a substitute
+void reLCD::releaseSlot(uint8_t location)
+{
+  if (_plan.slots[location] == 0) return;
+  _plan.slots[location] = 0;
+  for (uint8_t row = 0; row < _rows; row++) {
+    for (uint8_t col = 0; col < _lineCols; col++) {
+      if (_shadow[row][col] == location) _dirty[row] |= (1ULL << col);
     };
   };
+}
 
-  // Unknown char
-  return writeChar(chr);
+// Ranked substitutes for russian chars that do not fit into CGRAM
+void reLCD::setFallbacks(const lcd_fallback_t* fallbacks)
+{
+  lock();
+  _plan.fallbacks = fallbacks;
+  unlock();
 }
 
-uint8_t reLCD::write(uint8_t chr)
+// One upload plan for the whole frame: images are loaded before cells are drawn, so nothing is evicted mid-frame.
+// Images that do not fit into the frame budget are loaded by the following frames, until then cells show substitutes
+void reLCD::planFrame(uint32_t start)
 {
-  // English alphabet without change
-  if (chr < 128) {
-    return writeChar(chr);
-  } else {
-    // Russian alphabet using the same characters as the English alphabet
-    switch (chr) {
-      case 192: return writeChar('A');
-      case 194: return writeChar('B');
-      case 197: return writeChar('E');
-      case 168: return writeChar('E');
-      case 202: return writeChar('K');
-      case 204: return writeChar('M');
-      case 205: return writeChar('H');
-      case 206: return writeChar('O');
-      case 208: return writeChar('P');
-      case 209: return writeChar('C');
-      case 210: return writeChar('T');
-      case 213: return writeChar('X');
-      case 224: return writeChar('a');
-      case 229: return writeChar('e');
-      case 184: return writeChar('e');
-      case 238: return writeChar('o');
-      case 240: return writeChar('p');
-      case 241: return writeChar('c');
-      case 243: return writeChar('y');
-      case 245: return writeChar('x');
-      case 223: return writeChar(223);
-      default:  return writeRus(chr);
+  // The plan is solved on a copy, the mirror sees new locations only together with their images
+  lcd_cgram_plan_t plan = _plan;
+  lcdPlanBegin(&plan, _reserved | _userChars);
+  for (uint8_t row = 0; row < _rows; row++) {
+    lcdPlanCount(&plan, _frame[row], _lineCols);
+  };
+  uint8_t upload = lcdPlanSolve(&plan);
+  _planPending = false;
+  if (upload == 0) return;
+  changeBegin();
+  for (uint8_t i = 0; i < MAX_CUSTOM_CHARS; i++) {
+    if (upload & (1 << i)) {
+      if (overBudget(start)) {
+        _planPending = true;
+        break;
+      };
+      if (_plan.slots[i] != 0) LCD_STAT(cgram_evictions, 1);
+      _plan.slots[i] = plan.slots[i];
+      loadChar(i, lcdRusImage(_plan.slots[i]));
     };
   };
-  return 0;
+  changeEnd();
+  // Russian chars may now be shown from other locations or by substitutes
+  for (uint8_t row = 0; row < _rows; row++) {
+    for (uint8_t col = 0; col < _lineCols; col++) {
+      if (_frame[row][col] >= 128) _dirty[row] |= (1ULL << col);
+    };
+  };
+}
+
+// Converts a char of the frame buffer to the display code
+uint8_t reLCD::mapChar(uint8_t chr)
+{
+  return lcdPlanResolve(&_plan, chr);
 }
 
 #else
 
-uint16_t reLCD::write(uint8_t chr)
+// The russian ROM keeps cp1251 codes, only ° is taken from its place in the ROM, as before
+uint8_t reLCD::mapChar(uint8_t chr)
 {
-  return writeChar(chr);
+  return chr == 0xB0 ? 0xDF : chr;
 }
 
 #endif // LCD_RUS_USE_CUSTOM_CHARS
 
-uint8_t reLCD::printstr(const char* text)
+uint8_t reLCD::write(uint8_t chr)
 {
-  uint8_t len = strlen(text);
-  if (len > 0) {
-    uint8_t pos = 0;
-    while (pos < len) {
-      // utf-8 D0 :: А..Я а..п
-      if ((pos+1 < len) && (text[pos] == 0xD0) && (text[pos+1] >= 0x90) && (text[pos+1] <= 0xBF)) {
-        write(text[pos+1]+0x30);
-        pos += 2;
-      } 
-      // utf-8 D1 :: р..я
-      else if ((pos+1 < len) && (text[pos] == 0xD1) && (text[pos+1] >= 0x80) && (text[pos+1] <= 0x8F)) {
-        write(text[pos+1]+0x70);
-        pos += 2;
-      } 
-      // utf-8 C2 :: °
-      else if ((pos+1 < len) && (text[pos] == 0xC2) && (text[pos+1] == 0xB0)) {
-        write(0xDF);
-        pos += 2;
-      } 
-      else {
-        write(text[pos]);
-        pos++;
-      };
-    };
+  LCD_LATENCY_BEGIN();
+  lock();
+  changeBegin();
+  putChar(chr);
+  changeEnd();
+  commit();
+  LCD_LATENCY_END(LCD_CALL_WRITE);
+  unlock();
+  return 1;
+}
+
+uint8_t reLCD::printText(const char* text)
+{
+  size_t len = strlen(text);
+  size_t pos = 0;
+  while (pos < len) {
+    putChar(lcdDecodeUTF8(text, len, &pos));
   };
   return len;
 }
 
+uint8_t reLCD::printstr(const char* text)
+{
+  LCD_LATENCY_BEGIN();
+  lock();
+  changeBegin();
+  uint8_t len = printText(text);
+  changeEnd();
+  commit();
+  LCD_LATENCY_END(LCD_CALL_PRINT);
+  unlock();
+  return len;
+}
+
 uint8_t reLCD::printpos(uint8_t col, uint8_t row, const char* text)
 {
-  setCursor(col, row);
-  return printstr(text);
+  LCD_LATENCY_BEGIN();
+  lock();
+  changeBegin();
+  _col = constrainh(col, _lineCols - 1);
+  _row = constrainh(row, _rows - 1);
+  uint8_t len = printText(text);
+  changeEnd();
+  commit();
+  LCD_LATENCY_END(LCD_CALL_PRINT);
+  unlock();
+  return len;
 }
 
 uint8_t reLCD::printf(const char* fmtstr, ...)
 {
+  LCD_LATENCY_BEGIN();
+  lock();
   va_list args;
   va_start(args, fmtstr);
   uint8_t len = vsnprintf(nullptr, 0, fmtstr, args);
@@ -442,15 +770,23 @@ uint8_t reLCD::printf(const char* fmtstr, ...)
   };
   va_end(args);
   if (text) {
-    len = printstr((const char*)text);
+    changeBegin();
+    len = printText((const char*)text);
+    changeEnd();
+    commit();
     free(text);
+    LCD_LATENCY_END(LCD_CALL_PRINT);
+    unlock();
     return len;
   };
+  unlock();
   return 0;
 }
 
 uint8_t reLCD::printn(uint8_t col, uint8_t row, uint8_t width, const char* fmtstr, ...)
 {
+  LCD_LATENCY_BEGIN();
+  lock();
   va_list args;
   va_start(args, fmtstr);
   uint8_t len = vsnprintf(nullptr, 0, fmtstr, args);
@@ -460,61 +796,562 @@ uint8_t reLCD::printn(uint8_t col, uint8_t row, uint8_t width, const char* fmtst
   };
   va_end(args);
   if (text) {
-    setCursor(col, row);
+    changeBegin();
+    _col = constrainh(col, _lineCols - 1);
+    _row = constrainh(row, _rows - 1);
     int8_t shift = width - len;
     // If the result of formatting is shorter than the specified width, add spaces in front
     if (shift > 0) {
       for (size_t i = 0; i < shift; i++) {
-        writeChar(' ');
+        putChar(' ');
       };
     };
     // If the result of formatting is longer than the specified width, truncate the beginning of the string
     if (shift < 0) {
-      len = printstr((const char*)text - shift) + shift;
+      len = printText((const char*)text - shift) + shift;
     } else {
-      len = printstr((const char*)text) + shift;
+      len = printText((const char*)text) + shift;
     };
+    changeEnd();
+    commit();
     free(text);
+    LCD_LATENCY_END(LCD_CALL_PRINTN);
+    unlock();
     return len;
   };
+  unlock();
   return 0;
 }
 
+/*********** frame buffer ***********/
+
+void reLCD::setFrameRate(uint8_t fps)
+{
+  lock();
+  _frameInterval = fps > 0 ? 1000000 / fps : 0;
+  unlock();
+}
+
+void reLCD::setPriority(uint8_t col, uint8_t row, uint8_t width, lcd_priority_t priority)
+{
+  row = constrainh(row, _rows - 1);
+  col = constrainh(col, _lineCols - 1);
+  width = constrainh(width, _lineCols - col);
+  lock();
+  memset(&_prio[row][col], priority, width);
+  unlock();
+}
+
+bool reLCD::update()
+{
+  LCD_LATENCY_BEGIN();
+  lock();
+  bool sent = nextFrame();
+  LCD_LATENCY_END(LCD_CALL_UPDATE);
+  unlock();
+  return sent;
+}
+
+// Some changed cells have not been sent yet: deferred by the frame rate, low priority or the frame budget
+bool reLCD::isPending()
+{
+  bool pending = false;
+  lock();
+  for (uint8_t row = 0; row < _rows; row++) {
+    if (_dirty[row]) pending = true;
+  };
+  #if LCD_RUS_USE_CUSTOM_CHARS
+    if (_planPending) pending = true;
+  #endif // LCD_RUS_USE_CUSTOM_CHARS
+  unlock();
+  return pending;
+}
+
+bool reLCD::nextFrame()
+{
+  int64_t now = esp_timer_get_time();
+  if ((_frameInterval > 0) && (now - _frameTime < _frameInterval)) return false;
+  _frameTime = now;
+  // Animation frames and CGRAM images are charged to the frame budget too
+  uint32_t start = _txbytes;
+  animate(now, start);
+  // Low priority cells are deferred while the previous frame took more than half of the frame time
+  bool busy = (_frameInterval > 0) && (_busTime > _frameInterval / 2) 
+           && (now - _lowTime < (int64_t)CONFIG_LCD_LOW_PRIORITY_MAX_DEFER * 1000);
+  if (!busy) _lowTime = now;
+  flush(busy ? LCD_PRIORITY_NORMAL : LCD_PRIORITY_LOW, start);
+  _busTime = esp_timer_get_time() - now;
+  return true;
+}
+
+// Limits the time the display holds the bus: no more than size bytes per I2C transaction,
+// the bus is released for at least gap_ms between transactions of one frame
+void reLCD::setBusSlice(uint16_t size, uint8_t gap_ms)
+{
+  lock();
+  // at least one complete command
+  _sliceSize = constrainb(size, 6, CONFIG_LCD_TX_BUFFER_SIZE);
+  _sliceGap = gap_ms;
+  unlock();
+}
+
+// Limits the number of bytes per frame, the rest is sent by the following frames (0 - unlimited)
+void reLCD::setFrameBudget(uint16_t size)
+{
+  lock();
+  _flushBudget = size;
+  unlock();
+}
+
+// Called after every change of the frame buffer: only high priority cells may bypass the frame rate
+void reLCD::commit()
+{
+  if (!nextFrame()) {
+    flush(LCD_PRIORITY_HIGH, _txbytes);
+  };
+}
+
+// The frame has spent its budget: the rest waits for the following frames
+bool reLCD::overBudget(uint32_t start)
+{
+  return (_flushBudget > 0) && (_txbytes - start >= _flushBudget);
+}
+
+// Send changed cells with a priority not lower than specified, start - bytes counter at the beginning of the frame
+void reLCD::flush(uint8_t priority, uint32_t start)
+{
+  if (_txfault) resync();
+  // With autoscroll every char written shifts the display: changed cells wait until it is off, see putShifted()
+  uint8_t cells = _displaymode & LCD_ENTRYSHIFTINCREMENT ? 0 : _rows * _lineCols;
+  // Continue from the cell where the previous frame ran out of budget
+  uint8_t pos = _flushPos < cells ? _flushPos : 0;
+  bool changed = false;
+  txBegin();
+  #if LCD_RUS_USE_CUSTOM_CHARS
+    bool plan = _planPending;
+    for (uint8_t row = 0; row < _rows; row++) {
+      if (_dirty[row]) plan = true;
+    };
+    if (plan && (cells > 0)) planFrame(start);
+  #endif // LCD_RUS_USE_CUSTOM_CHARS
+  for (uint8_t i = 0; i < cells; i++, pos++) {
+    if (pos >= cells) pos = 0;
+    uint8_t row = pos / _lineCols;
+    uint8_t col = pos % _lineCols;
+    uint64_t bit = 1ULL << col;
+    if (!(_dirty[row] & bit) || (_prio[row][col] < priority)) continue;
+    if (overBudget(start)) {
+      _flushPos = pos;
+      break;
+    };
+    _dirty[row] &= ~bit;
+    uint8_t code = mapChar(_frame[row][col]);
+    if (code == _shadow[row][col]) {
+      LCD_STAT(cells_skipped, 1);
+      continue;
+    };
+    if (!changed) {
+      changeBegin();
+      changed = true;
+    };
+    uint8_t addr = row_offsets[row] + col;
+    if (_ddram != addr) {
+      command(LCD_SETDDRAMADDR | addr);
+    };
+    send(code, Rs);
+    LCD_STAT(cells_sent, 1);
+    _shadow[row][col] = code;
+    _ddram = _displaymode & LCD_ENTRYLEFT ? addr + 1 : addr - 1;
+  };
+  // The visible cursor must stay where the application placed it
+  if (_displaycontrol & (LCD_CURSORON | LCD_BLINKON)) {
+    uint8_t addr = row_offsets[_row] + _col;
+    if (_ddram != addr) {
+      if (!changed) {
+        changeBegin();
+        changed = true;
+      };
+      command(LCD_SETDDRAMADDR | addr);
+      _ddram = addr;
+    };
+  };
+  txEnd();
+  if (changed) changeEnd();
+  #if CONFIG_LCD_STATS
+    // From the first change to the moment the whole frame is handed over to the bus
+    if (_dirtyTime != 0) {
+      bool pending = false;
+      for (uint8_t row = 0; row < _rows; row++) {
+        if (_dirty[row]) pending = true;
+      };
+      if (!pending) {
+        statLatency(_stats.visible, _dirtyTime);
+        _dirtyTime = 0;
+      };
+    };
+  #endif // CONFIG_LCD_STATS
+}
+
 /*********** low level data pushing commands ***********/
 
 // write either command or data
 void reLCD::send(uint8_t value, uint8_t mode) 
 {
+  if (_parallel) {
+    gpioSend(value, mode);
+    return;
+  };
 	uint8_t highnib = value & 0xF0;
 	uint8_t lownib = value << 4;
+  txBegin();
+  // keep both nibbles in one transaction
+  txReserve(6);
 	write4bits((highnib)|mode);
 	write4bits((lownib)|mode);
+  txEnd();
 }
 
 void reLCD::write4bits(uint8_t value) 
 {
+  if (_parallel) {
+    gpioWrite(_displayfunction & LCD_8BITMODE ? 0xFF : 0xF0, value, 0);
+    delayUs(40);
+    LCD_STAT(busy_wait_us, 40);
+    return;
+  };
+  txBegin();
+  txReserve(3);
 	expanderWrite(value);
 	pulseEnable(value);
+  txEnd();
 }
 
 void reLCD::expanderWrite(uint8_t data)
 {       
-  uint8_t buf = (int)(data) | _backlightval;
-  esp_err_t err = writeI2C(_I2C_num, _I2C_addr, &buf, 1, nullptr, 0, 5000);                                 
-  if (err != ESP_OK) {
-    err = writeI2C(_I2C_num, _I2C_addr, &buf, 1, nullptr, 0, 5000);                                 
+  if (_parallel) {
+    // all control lines low
+    pinWrite(LCD_PIN_RS | LCD_PIN_RW | LCD_PIN_EN, 0);
+    return;
   };
+  txBegin();
+  txReserve(1);
+  _txbuf[_txcur][_txlen[_txcur]++] = data | _backlightval;
+  _txbytes++;
+  txEnd();
 }
 
+// Bytes of one buffer are clocked out back to back: each byte takes at least 22.5us at 400 kHz,
+// so the enable pulse (>450ns) and the settle time between nibbles (>37us) are provided by the bus itself
 void reLCD::pulseEnable(uint8_t data)
 {
 	expanderWrite(data | En);	 // En high
-	ets_delay_us(1);		       // enable pulse must be >450ns
-	
 	expanderWrite(data & ~En); // En low
-	ets_delay_us(40);		       // commands need > 37us to settle
 }
 
+/*********** parallel interface ***********/
+
+void reLCD::setPinWriter(lcd_pin_writer_t writer, void* arg, lcd_pin_delay_t delay)
+{
+  lock();
+  _pinWriter = writer;
+  _pinDelay = delay;
+  _pinArg = arg;
+  unlock();
+}
+
+// Timing of the display goes through the delay hook, so a simulator sees it and the host does not wait
+void reLCD::delayUs(uint32_t us)
+{
+  if (_pinDelay) {
+    _pinDelay(_pinArg, us);
+  } else {
+    ets_delay_us(us);
+  };
+}
+
+void reLCD::delayMs(uint32_t ms)
+{
+  if (_pinDelay) {
+    _pinDelay(_pinArg, ms * 1000);
+  } else {
+    vTaskDelay(pdMS_TO_TICKS(ms));
+  };
+}
+
+void reLCD::gpioStart()
+{
+  if (_pinWriter) return;
+  uint8_t first = _bitmode & LCD_8BITMODE ? 0 : 4;
+  gpio_config_t cfg = {};
+  cfg.mode = GPIO_MODE_OUTPUT;
+  for (uint8_t i = first; i < 8; i++) {
+    cfg.pin_bit_mask |= (1ULL << _gpio.data[i]);
+  };
+  cfg.pin_bit_mask |= (1ULL << _gpio.rs) | (1ULL << _gpio.en);
+  if (_gpio.rw != GPIO_NUM_NC) cfg.pin_bit_mask |= (1ULL << _gpio.rw);
+  if (_gpio.backlight != GPIO_NUM_NC) cfg.pin_bit_mask |= (1ULL << _gpio.backlight);
+  gpio_config(&cfg);
+  #if SOC_DEDICATED_GPIO_SUPPORTED
+    // Data lines, then RS, E and RW while channels remain, are switched by one write to the dedicated GPIO bundle,
+    // in 4-bit mode this covers all lines of a nibble. Lines outside the bundle are switched one by one
+    if ((_bundle == nullptr) && ((8 - first) <= SOC_DEDIC_GPIO_OUT_CHANNELS_NUM)) {
+      int lines[SOC_DEDIC_GPIO_OUT_CHANNELS_NUM];
+      uint8_t count = 0;
+      for (uint8_t i = first; i < 8; i++) {
+        _bundlePins[count] = 1 << i;
+        lines[count++] = _gpio.data[i];
+      };
+      const gpio_num_t control[3] = { _gpio.rs, _gpio.en, _gpio.rw };
+      const uint16_t control_pins[3] = { LCD_PIN_RS, LCD_PIN_EN, LCD_PIN_RW };
+      for (uint8_t i = 0; (i < 3) && (count < SOC_DEDIC_GPIO_OUT_CHANNELS_NUM); i++) {
+        if (control[i] == GPIO_NUM_NC) continue;
+        _bundlePins[count] = control_pins[i];
+        lines[count++] = control[i];
+      };
+      dedic_gpio_bundle_config_t bundle_cfg = {};
+      bundle_cfg.gpio_array = lines;
+      bundle_cfg.array_size = count;
+      bundle_cfg.flags.out_en = 1;
+      if (dedic_gpio_new_bundle(&bundle_cfg, &_bundle) == ESP_OK) {
+        _bundleSize = count;
+        _bundleLines = 0;
+        for (uint8_t i = 0; i < count; i++) {
+          _bundleLines |= _bundlePins[i];
+        };
+      } else {
+        _bundle = nullptr;
+      };
+    };
+  #endif // SOC_DEDICATED_GPIO_SUPPORTED
+}
+
+// mask - lines to be changed, value - their new states (LCD_PIN_xxx)
+void reLCD::pinWrite(uint16_t mask, uint16_t value)
+{
+  if (_pinWriter) {
+    _pinWriter(_pinArg, mask, value);
+    return;
+  };
+  #if SOC_DEDICATED_GPIO_SUPPORTED
+    if (_bundle && (mask & _bundleLines)) {
+      uint32_t bundle_mask = 0;
+      uint32_t bundle_value = 0;
+      for (uint8_t i = 0; i < _bundleSize; i++) {
+        if (mask & _bundlePins[i]) {
+          bundle_mask |= (1 << i);
+          if (value & _bundlePins[i]) bundle_value |= (1 << i);
+        };
+      };
+      dedic_gpio_bundle_write(_bundle, bundle_mask, bundle_value);
+      mask &= ~_bundleLines;
+    };
+  #endif // SOC_DEDICATED_GPIO_SUPPORTED
+  uint8_t data = mask & 0xFF;
+  for (uint8_t i = 0; data; i++, data >>= 1) {
+    if (data & 1) gpio_set_level(_gpio.data[i], (value >> i) & 1);
+  };
+  if (mask & LCD_PIN_RS) gpio_set_level(_gpio.rs, (value & LCD_PIN_RS) ? 1 : 0);
+  if ((mask & LCD_PIN_RW) && (_gpio.rw != GPIO_NUM_NC)) gpio_set_level(_gpio.rw, (value & LCD_PIN_RW) ? 1 : 0);
+  if (mask & LCD_PIN_EN) gpio_set_level(_gpio.en, (value & LCD_PIN_EN) ? 1 : 0);
+  if ((mask & LCD_PIN_BL) && (_gpio.backlight != GPIO_NUM_NC)) gpio_set_level(_gpio.backlight, (value & LCD_PIN_BL) ? 1 : 0);
+}
+
+// Set data lines and RS, then strobe E
+void reLCD::gpioWrite(uint8_t lines, uint8_t data, uint16_t rs)
+{
+  pinWrite(lines | LCD_PIN_RS, (data & lines) | rs);
+  pinWrite(LCD_PIN_EN, LCD_PIN_EN);  // En high
+  delayUs(1);                        // enable pulse must be >450ns
+  pinWrite(LCD_PIN_EN, 0);           // En low
+  delayUs(1);                        // enable cycle must be >1000ns, the next nibble may follow at once
+  LCD_STAT(busy_wait_us, 2);
+}
+
+void reLCD::gpioSend(uint8_t value, uint8_t mode)
+{
+  uint16_t rs = mode & Rs ? LCD_PIN_RS : 0;
+  if (_displayfunction & LCD_8BITMODE) {
+    gpioWrite(0xFF, value, rs);
+  } else {
+    gpioWrite(0xF0, value & 0xF0, rs);
+    gpioWrite(0xF0, value << 4, rs);
+  };
+  delayUs(40);                       // commands need > 37us to settle
+  _txbytes++;
+  LCD_STAT(busy_wait_us, 40);
+  LCD_STAT(bytes, 1);
+}
+
+/*********** locking ***********/
+
+// Public calls may come from different tasks, nested calls of the same task are allowed
+void reLCD::lock()
+{
+  if (_lock) xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+}
+
+void reLCD::unlock()
+{
+  if (_lock) xSemaphoreGiveRecursive(_lock);
+}
+
+/*********** transmit buffer ***********/
+
+void reLCD::txBegin()
+{
+  _txdepth++;
+}
+
+void reLCD::txEnd()
+{
+  if (_txdepth > 0) _txdepth--;
+  if (_txdepth == 0) txFlush();
+}
+
+// Send the slice in advance if the next sequence does not fit into it, so the sequence is never split
+void reLCD::txReserve(uint8_t size)
+{
+  if (_txlen[_txcur] + size > _sliceSize) {
+    txFlush();
+    // give other devices on the bus a chance between slices: the gap starts when the previous slice has left the wire
+    if (_sliceGap > 0) {
+      txWait();
+      txGap();
+    };
+  };
+}
+
+void reLCD::txGap()
+{
+  if (_sliceGap > 0) {
+    TickType_t ticks = pdMS_TO_TICKS(_sliceGap);
+    vTaskDelay(ticks > 0 ? ticks : 1);
+  };
+}
+
+void reLCD::txSend(uint8_t* buf, uint16_t len)
+{
+  LCD_STAT(transactions, 1);
+  LCD_STAT(bytes, len);
+  // After a failure the display may wait for the second nibble: the following buffers are dropped until resync()
+  if (_txfault) return;
+  esp_err_t err = writeI2C(_I2C_num, _I2C_addr, buf, len, nullptr, 0, CONFIG_LCD_I2C_TIMEOUT);
+  if (err != ESP_OK) {
+    // Some bytes may have reached the display, repeating the buffer would shift the nibbles
+    LCD_STAT(failures, 1);
+    _txfault = true;
+  };
+}
+
+// The interface is initialized again by instructions (datasheet, figure 24), DDRAM and CGRAM contents are 
+// unknown: the display is cleared, every cell is redrawn and known images are uploaded again
+void reLCD::resync()
+{
+  txWait();
+  _txfault = false;
+  LCD_STAT(resyncs, 1);
+  changeBegin();
+  txBegin();
+  write4bits(0x30);
+  txDelay(4500);
+  write4bits(0x30);
+  txDelay(150);
+  write4bits(0x30);
+  txDelay(150);
+  if (!(_displayfunction & LCD_8BITMODE)) {
+    write4bits(0x20);
+  };
+  command(LCD_FUNCTIONSET | _displayfunction);
+  command(LCD_DISPLAYCONTROL | _displaycontrol);
+  command(LCD_CLEARDISPLAY);
+  txDelay(2000);
+  command(LCD_ENTRYMODESET | _displaymode);
+  // clear display has reset the shift, it is restored the shorter way
+  for (uint8_t i = 0; i < _shift && i < LCD_DDRAM_COLS - _shift; i++) {
+    command(LCD_CURSORSHIFT | LCD_DISPLAYMOVE | (_shift <= LCD_DDRAM_COLS / 2 ? LCD_MOVELEFT : LCD_MOVERIGHT));
+  };
+  memset(_shadow, ' ', sizeof(_shadow));
+  _ddram = 0;
+  for (uint8_t row = 0; row < _rows; row++) {
+    _dirty[row] = (1ULL << _lineCols) - 1;
+  };
+  uint8_t valid = _cgramValid;
+  _cgramValid = 0;
+  for (uint8_t i = 0; i < MAX_CUSTOM_CHARS; i++) {
+    if (valid & (1 << i)) loadChar(i, _cgram[i]);
+  };
+  txEnd();
+  changeEnd();
+}
+
+void reLCD::txFlush()
+{
+  uint8_t idx = _txcur;
+  if (_txlen[idx] == 0) return;
+  #if CONFIG_LCD_TX_PIPELINE
+    if (_txtask) {
+      // Wait for the previous buffer to leave the wire, hand over the current one and continue in the other
+      xSemaphoreTake(_txidle, portMAX_DELAY);
+      _txsend = idx;
+      _txcur = idx ^ 1;
+      xTaskNotifyGive(_txtask);
+      return;
+    };
+  #endif // CONFIG_LCD_TX_PIPELINE
+  txSend(_txbuf[idx], _txlen[idx]);
+  _txlen[idx] = 0;
+}
+
+// Wait until all handed over data has been transmitted
+void reLCD::txWait()
+{
+  #if CONFIG_LCD_TX_PIPELINE
+    if (_txtask) {
+      xSemaphoreTake(_txidle, portMAX_DELAY);
+      xSemaphoreGive(_txidle);
+    };
+  #endif // CONFIG_LCD_TX_PIPELINE
+}
+
+// Send everything encoded so far and wait for the execution of a long command
+void reLCD::txDelay(uint32_t us)
+{
+  txFlush();
+  txWait();
+  delayUs(us);
+  LCD_STAT(busy_wait_us, us);
+}
+
+#if CONFIG_LCD_TX_PIPELINE
+
+void reLCD::txTask(void* arg)
+{
+  reLCD* lcd = (reLCD*)arg;
+  while (1) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    uint8_t idx = lcd->_txsend;
+    lcd->txSend(lcd->_txbuf[idx], lcd->_txlen[idx]);
+    lcd->_txlen[idx] = 0;
+    xSemaphoreGive(lcd->_txidle);
+  };
+}
+
+// If the task cannot be started, buffers are sent synchronously
+void reLCD::txStart()
+{
+  if (_txtask) return;
+  if (!_txidle) {
+    _txidle = xSemaphoreCreateBinary();
+    if (!_txidle) return;
+    xSemaphoreGive(_txidle);
+  };
+  if (xTaskCreate(txTask, "lcd_tx", CONFIG_LCD_TX_TASK_STACK_SIZE, this, CONFIG_LCD_TX_TASK_PRIORITY, &_txtask) != pdPASS) {
+    _txtask = nullptr;
+  };
+}
+
+#endif // CONFIG_LCD_TX_PIPELINE
+
 // Create custom characters for horizontal graphs
 uint8_t reLCD::graphHorizontalChars(uint8_t rowPattern) 
 {
@@ -544,10 +1381,13 @@ uint8_t reLCD::graphVerticalChars(uint8_t rowPattern)
 // Initializes custom characters for input graph type
 uint8_t reLCD::init_bargraph(uint8_t graphtype) 
 {
+  LCD_LATENCY_BEGIN();
+  lock();
   // Initialize row state vector
   for(uint8_t i = 0; i < _rows; i++) {
     _graphstate[i] = 255;
   }
+  txBegin();
 	switch (graphtype) {
 		case LCDI2C_VERTICAL_BAR_GRAPH:
       graphVerticalChars(B11111);
@@ -563,34 +1403,42 @@ uint8_t reLCD::init_bargraph(uint8_t graphtype)
       graphHorizontalChars(B00001);
 			break;
 		default:
+      txEnd();
+      unlock();
 			return 1;
 	}
+  txEnd();
   _graphtype = graphtype;
+  LCD_LATENCY_END(LCD_CALL_GRAPH);
+  unlock();
 	return 0;
 }
 
 // Display horizontal graph from desired cursor position with input value
 void reLCD::draw_horizontal_graph(uint8_t row, uint8_t column, uint8_t len, uint8_t pixel_col_end)
 {
+  LCD_LATENCY_BEGIN();
+  lock();
   // Maintain input parameters
   row = constrainh(row, _rows - 1);
   column = constrainh(column, _cols - 1);
   len = constrainh(len, _cols - column);
   pixel_col_end = constrainh(pixel_col_end, (len * LCD_CHARACTER_HORIZONTAL_DOTS) - 1);
   _graphstate[row] = constrainb(_graphstate[row], column, column + len - 1);
+  changeBegin();
   // Display graph
   switch (_graphtype) {
     case LCDI2C_HORIZONTAL_BAR_GRAPH:
-      setCursor(column, row);
+      _col = column; _row = row;
       // Display full characters
       for (uint8_t i = 0; i < pixel_col_end / LCD_CHARACTER_HORIZONTAL_DOTS; i++) {
-        write(LCD_CHARACTER_HORIZONTAL_DOTS - 1);
+        putChar(LCD_CHARACTER_HORIZONTAL_DOTS - 1);
         column++;
       }
       // Display last character
-      write(pixel_col_end % LCD_CHARACTER_HORIZONTAL_DOTS);
+      putChar(pixel_col_end % LCD_CHARACTER_HORIZONTAL_DOTS);
       // Clear remaining chars in segment
-      for (uint8_t i = column; i < _graphstate[row]; i++) write(' ');
+      for (uint8_t i = column; i < _graphstate[row]; i++) putChar(' ');
       // Last drawn column as graph state
       _graphstate[row] = column;
       break;
@@ -599,49 +1447,60 @@ void reLCD::draw_horizontal_graph(uint8_t row, uint8_t column, uint8_t len, uint
       column += pixel_col_end / LCD_CHARACTER_HORIZONTAL_DOTS;
       // Clear previous drawn character if differs from new one
       if (_graphstate[row] != column) {
-        setCursor(_graphstate[row], row);
-        write(' ');
+        _col = _graphstate[row]; _row = row;
+        putChar(' ');
         _graphstate[row] = column;
       }
       // Display graph character
-      setCursor(column, row);
-      write(pixel_col_end % LCD_CHARACTER_HORIZONTAL_DOTS);
+      _col = column; _row = row;
+      putChar(pixel_col_end % LCD_CHARACTER_HORIZONTAL_DOTS);
       break;
 		default:
-			return;
+			break;
   }
+  changeEnd();
+  commit();
+  LCD_LATENCY_END(LCD_CALL_GRAPH);
+  unlock();
 }
 
 // Display horizontal graph from desired cursor position with input value
 void reLCD::draw_vertical_graph(uint8_t row, uint8_t column, uint8_t len,  uint8_t pixel_row_end) 
 {
+  LCD_LATENCY_BEGIN();
+  lock();
   // Maintain input parameters
   row = constrainh(row, _rows - 1);
   column = constrainh(column, _cols - 1);
   len = constrainh(len, row + 1);
   pixel_row_end = constrainh(pixel_row_end, (len * LCD_CHARACTER_VERTICAL_DOTS) - 1);
   _graphstate[column] = constrainb(_graphstate[column], row - len + 1, row);
+  changeBegin();
   // Display graph
 	switch (_graphtype) {
     case LCDI2C_VERTICAL_BAR_GRAPH:
       // Display full characters
       for (uint8_t i = 0; i < pixel_row_end / LCD_CHARACTER_VERTICAL_DOTS; i++) {
-        setCursor(column, row--);
-        write(LCD_CHARACTER_VERTICAL_DOTS - 1);
+        _col = column; _row = row--;
+        putChar(LCD_CHARACTER_VERTICAL_DOTS - 1);
       }
       // Display the highest character
-      setCursor(column, row);
-      write(pixel_row_end % LCD_CHARACTER_VERTICAL_DOTS);
+      _col = column; _row = row;
+      putChar(pixel_row_end % LCD_CHARACTER_VERTICAL_DOTS);
       // Clear remaining top chars in column
       for (uint8_t i = _graphstate[column]; i < row; i++) {
-        setCursor(column, i);
-        write(' ');
+        _col = column; _row = i;
+        putChar(' ');
       }
       _graphstate[column] = row; // Last drawn row as its state
       break;
 		default:
-			return;
+			break;
   }
+  changeEnd();
+  commit();
+  LCD_LATENCY_END(LCD_CALL_GRAPH);
+  unlock();
 }
 
 // Overloaded methods
@@ -669,3 +1528,152 @@ void reLCD::draw_vertical_graph(uint8_t row, uint8_t column, uint8_t len,  float
   draw_vertical_graph(row, column, len, (uint8_t) ratio);
 }
 
+/*********** screen mirror ***********/
+
+// HD44780 codes currently shown in the row
+const uint8_t* reLCD::getScreenRow(uint8_t row)
+{
+  return _shadow[constrainh(row, _rows - 1)];
+}
+
+// Images of custom chars: 8 rows for each of 8 locations
+const uint8_t* reLCD::getCGRAM()
+{
+  return &_cgram[0][0];
+}
+
+void reLCD::getState(lcd_state_t* state)
+{
+  lock();
+  state->cols = _cols;
+  state->rows = _rows;
+  state->width = _lineCols;
+  state->col = _col;
+  state->row = _row;
+  state->shift = _shift;
+  state->control = _displaycontrol;
+  state->mode = _displaymode;
+  state->backlight = _backlightval != LCD_NOBACKLIGHT;
+  unlock();
+}
+
+// Changed every time the display contents or state change, odd while they are being changed
+uint32_t reLCD::getSequence()
+{
+  return __atomic_load_n(&_sequence, __ATOMIC_ACQUIRE);
+}
+
+// Seqlock: the sequence becomes odd before the first write and even again after the last one, nested changes are merged
+void reLCD::changeBegin()
+{
+  if (_seqDepth++ == 0) {
+    __atomic_store_n(&_sequence, _sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  };
+}
+
+void reLCD::changeEnd()
+{
+  if ((_seqDepth > 0) && (--_seqDepth == 0)) {
+    __atomic_store_n(&_sequence, _sequence + 1, __ATOMIC_RELEASE);
+  };
+}
+
+// Unicode code point of a cp1251 char
+static uint16_t cp1251ToUnicode(uint8_t chr)
+{
+  if (chr < 0x80) return chr;
+  if (chr >= 0xC0) return 0x0410 + (chr - 0xC0);
+  switch (chr) {
+    case 0xA8: return 0x0401; // Ё
+    case 0xB8: return 0x0451; // ё
+    case 0xB0: return 0x00B0; // °
+  };
+  return '?';
+}
+
+// Unicode code point of the char shown by the display code
+uint16_t reLCD::codeToUnicode(uint8_t code)
+{
+  if (code < MAX_CUSTOM_CHARS) {
+    #if LCD_RUS_USE_CUSTOM_CHARS
+      if (_plan.slots[code] != 0) return cp1251ToUnicode(_plan.slots[code]);
+    #endif // LCD_RUS_USE_CUSTOM_CHARS
+    // user image, bar graph or animation
+    return 0x2592;
+  };
+  switch (code) {
+    case 0x5C: return 0x00A5; // ¥ in ROM A00
+    case 0x7E: return 0x2192; // →
+    case 0x7F: return 0x2190; // ←
+    case 0xDF: return 0x00B0; // °
+  };
+  if (code < 0x20) return '?';
+  // cp1251: ROM with russian chars or chars loaded into CGRAM
+  return cp1251ToUnicode(code);
+}
+
+// Writes the row as a null-terminated UTF-8 string, returns its length.
+// Sent russian chars are taken from the frame buffer, so latin lookalikes and substitutes are exported as written
+size_t reLCD::exportUTF8(uint8_t row, char* buf, size_t size)
+{
+  if ((buf == nullptr) || (size == 0)) return 0;
+  lock();
+  row = constrainh(row, _rows - 1);
+  size_t len = 0;
+  for (uint8_t i = 0; i < _cols; i++) {
+    // The display shift moves the visible window over the 40 char line of DDRAM,
+    // on 4 row displays the second half of the line is the row below the next one
+    uint8_t pos = ((row_offsets[row] & 0x3F) + i + _shift) % LCD_DDRAM_COLS;
+    uint8_t line = _lineCols < LCD_DDRAM_COLS ? (row & 1) + (pos >= _lineCols ? 2 : 0) : row;
+    uint8_t col = pos % _lineCols;
+    uint8_t chr = _frame[line][col];
+    bool sent = !(_dirty[line] & (1ULL << col));
+    uint16_t cp = sent && (chr >= 0x80) ? cp1251ToUnicode(chr) : codeToUnicode(_shadow[line][col]);
+    uint8_t need = cp < 0x80 ? 1 : (cp < 0x800 ? 2 : 3);
+    if (len + need >= size) break;
+    if (need == 1) {
+      buf[len++] = cp;
+    } else if (need == 2) {
+      buf[len++] = 0xC0 | (cp >> 6);
+      buf[len++] = 0x80 | (cp & 0x3F);
+    } else {
+      buf[len++] = 0xE0 | (cp >> 12);
+      buf[len++] = 0x80 | ((cp >> 6) & 0x3F);
+      buf[len++] = 0x80 | (cp & 0x3F);
+    };
+  };
+  buf[len] = 0;
+  unlock();
+  return len;
+}
+
+#if CONFIG_LCD_STATS
+
+/*********** statistics ***********/
+
+void reLCD::getStats(lcd_stats_t* stats)
+{
+  lock();
+  memcpy(stats, &_stats, sizeof(lcd_stats_t));
+  unlock();
+}
+
+void reLCD::resetStats()
+{
+  lock();
+  memset(&_stats, 0, sizeof(lcd_stats_t));
+  _dirtyTime = 0;
+  unlock();
+}
+
+// Buckets: < 16 us, < 64 us, < 256 us, < 1 ms, < 4 ms, < 16 ms, < 64 ms, >= 64 ms
+void reLCD::statLatency(uint32_t* histogram, int64_t start)
+{
+  int64_t time = esp_timer_get_time() - start;
+  uint8_t i = 0;
+  while ((i < LCD_STATS_BUCKETS - 1) && (time >= (16LL << (2 * i)))) i++;
+  histogram[i]++;
+}
+
+#endif // CONFIG_LCD_STATS
@@ -0,0 +1,304 @@
+#include "reLCDPlanner.h"
+#include <string.h>
+
+typedef struct {
+  uint8_t rastr[8];   // Symbol bitmap
+  uint8_t charcode;   // Character code in unicode
+} image_char_t;
+
+// Russian symbols
+static const image_char_t rus_chars[] = {
+  {{0b11111, 0b10000, 0b10000, 0b11110, 0b10001, 0b10001, 0b11110, 0b00000}, 193}, // 0x0411, 0xD091, 193 :: Б
+  {{0b11111, 0b10000, 0b10000, 0b10000, 0b10000, 0b10000, 0b10000, 0b00000}, 195}, // 0x0413, 0xD093, 195 :: Г
+  {{0b00110, 0b01010, 0b01010, 0b01010, 0b01010, 0b01010, 0b11111, 0b10001}, 196}, // 0x0414, 0xD094, 196 :: Д
+  {{0b10101, 0b10101, 0b10101, 0b01110, 0b10101, 0b10101, 0b10101, 0b00000}, 198}, // 0x0416, 0xD096, 198 :: Ж
+  {{0b01110, 0b10001, 0b00001, 0b00110, 0b00001, 0b10001, 0b01110, 0b00000}, 199}, // 0x0417, 0xD097, 199 :: З
+  {{0b10001, 0b10001, 0b10001, 0b10011, 0b10101, 0b11001, 0b10001, 0b00000}, 200}, // 0x0418, 0xD098, 200 :: И
+  {{0b10101, 0b10001, 0b10001, 0b10011, 0b10101, 0b11001, 0b10001, 0b00000}, 201}, // 0x0419, 0xD099, 201 :: Й
+  {{0b00111, 0b01001, 0b01001, 0b01001, 0b01001, 0b01001, 0b10001, 0b00000}, 203}, // 0x041B, 0xD09B, 203 :: Л
+  {{0b11111, 0b10001, 0b10001, 0b10001, 0b10001, 0b10001, 0b10001, 0b00000}, 207}, // 0x041F, 0xD09F, 207 :: П
+  {{0b10001, 0b10001, 0b10001, 0b01111, 0b00001, 0b10001, 0b01110, 0b00000}, 211}, // 0x0423, 0xD0A3, 211 :: У
+  {{0b00100, 0b01110, 0b10101, 0b10101, 0b10101, 0b01110, 0b00100, 0b00000}, 212}, // 0x0424, 0xD0A4, 212 :: Ф
+  {{0b10010, 0b10010, 0b10010, 0b10010, 0b10010, 0b10010, 0b11111, 0b00001}, 214}, // 0x0426, 0xD0A6, 214 :: Ц
+  {{0b10001, 0b10001, 0b10001, 0b01111, 0b00001, 0b00001, 0b00001, 0b00000}, 215}, // 0x0427, 0xD0A7, 215 :: Ч
+  {{0b10001, 0b10001, 0b10001, 0b10101, 0b10101, 0b10101, 0b11111, 0b00000}, 216}, // 0x0428, 0xD0A8, 216 :: Ш
+  {{0b10001, 0b10001, 0b10001, 0b10101, 0b10101, 0b10101, 0b11111, 0b00001}, 217}, // 0x0429, 0xD0A9, 217 :: Щ
+  {{0b11000, 0b01000, 0b01000, 0b01110, 0b01001, 0b01001, 0b01110, 0b00000}, 218}, // 0x042A, 0xD0AA, 218 :: Ъ
+  {{0b10001, 0b10001, 0b10001, 0b11101, 0b10011, 0b10011, 0b11101, 0b00000}, 219}, // 0x042B, 0xD0AB, 219 :: Ы
+  {{0b10000, 0b10000, 0b10000, 0b11110, 0b10001, 0b10001, 0b11110, 0b00000}, 220}, // 0x042C, 0xD0AC, 220 :: Ь
+  {{0b01110, 0b10001, 0b00001, 0b00111, 0b00001, 0b10001, 0b01110, 0b00000}, 221}, // 0x042D, 0xD0AD, 221 :: Э
+  {{0b10010, 0b10101, 0b10101, 0b11101, 0b10101, 0b10101, 0b10010, 0b00000}, 222}, // 0x042E, 0xD0AE, 222 :: Ю
+  {{0b01111, 0b10001, 0b10001, 0b01111, 0b00101, 0b01001, 0b10001, 0b00000}, 223}, // 0x042F, 0xD0AF, 223 :: Я
+  {{0b00011, 0b01100, 0b10000, 0b11110, 0b10001, 0b10001, 0b01110, 0b00000}, 225}, // 0x0431, 0xD0B1, 225 :: б
+  {{0b00000, 0b00000, 0b11110, 0b10001, 0b11110, 0b10001, 0b11110, 0b00000}, 226}, // 0x0432, 0xD0B2, 226 :: в
+  {{0b00000, 0b00000, 0b11110, 0b10000, 0b10000, 0b10000, 0b10000, 0b00000}, 227}, // 0x0433, 0xD0B3, 227 :: г
+  {{0b00000, 0b00000, 0b00110, 0b01010, 0b01010, 0b01010, 0b11111, 0b10001}, 228}, // 0x0434, 0xD0B4, 228 :: д
+  {{0b01010, 0b00000, 0b01110, 0b10001, 0b11111, 0b10000, 0b01111, 0b00000}, 184}, // 0x0451, 0xD191, 184 :: ё
+  {{0b00000, 0b00000, 0b10101, 0b10101, 0b01110, 0b10101, 0b10101, 0b00000}, 230}, // 0x0436, 0xD0B6, 230 :: ж
+  {{0b00000, 0b00000, 0b01110, 0b10001, 0b00110, 0b10001, 0b01110, 0b00000}, 231}, // 0x0437, 0xD0B7, 231 :: з
+  {{0b00000, 0b00000, 0b10001, 0b10011, 0b10101, 0b11001, 0b10001, 0b00000}, 232}, // 0x0438, 0xD0B8, 232 :: и
+  {{0b01010, 0b00100, 0b10001, 0b10011, 0b10101, 0b11001, 0b10001, 0b00000}, 233}, // 0x0439, 0xD0B9, 233 :: й
+  {{0b00000, 0b00000, 0b10010, 0b10100, 0b11000, 0b10100, 0b10010, 0b00000}, 234}, // 0x043A, 0xD0BA, 234 :: к
+  {{0b00000, 0b00000, 0b00111, 0b01001, 0b01001, 0b01001, 0b10001, 0b00000}, 235}, // 0x043B, 0xD0BB, 235 :: л
+  {{0b00000, 0b00000, 0b10001, 0b11011, 0b10101, 0b10001, 0b10001, 0b00000}, 236}, // 0x043C, 0xD0BC, 236 :: м
+  {{0b00000, 0b00000, 0b10001, 0b10001, 0b11111, 0b10001, 0b10001, 0b00000}, 237}, // 0x043D, 0xD0BD, 237 :: н
+  {{0b00000, 0b00000, 0b11111, 0b10001, 0b10001, 0b10001, 0b10001, 0b00000}, 239}, // 0x043F, 0xD0BF, 239 :: п
+  {{0b00000, 0b00000, 0b11111, 0b00100, 0b00100, 0b00100, 0b00100, 0b00000}, 242}, // 0x0442, 0xD182, 242 :: т
+  {{0b00000, 0b00000, 0b00100, 0b01110, 0b10101, 0b01110, 0b00100, 0b00000}, 244}, // 0x0444, 0xD184, 244 :: ф
+  {{0b00000, 0b00000, 0b10010, 0b10010, 0b10010, 0b10010, 0b11111, 0b00001}, 246}, // 0x0446, 0xD186, 246 :: ц
+  {{0b00000, 0b00000, 0b10001, 0b10001, 0b01111, 0b00001, 0b00001, 0b00000}, 247}, // 0x0447, 0xD187, 247 :: ч
+  {{0b00000, 0b00000, 0b10101, 0b10101, 0b10101, 0b10101, 0b11111, 0b00000}, 248}, // 0x0448, 0xD188, 248 :: ш
+  {{0b00000, 0b00000, 0b10101, 0b10101, 0b10101, 0b10101, 0b11111, 0b00001}, 249}, // 0x0449, 0xD189, 249 :: щ
+  {{0b00000, 0b00000, 0b11000, 0b01000, 0b01110, 0b01001, 0b01110, 0b00000}, 250}, // 0x044A, 0xD18A, 250 :: ъ
+  {{0b00000, 0b00000, 0b10001, 0b10001, 0b11101, 0b10011, 0b11101, 0b00000}, 251}, // 0x044B, 0xD18B, 251 :: ы
+  {{0b00000, 0b00000, 0b10000, 0b10000, 0b11110, 0b10001, 0b11110, 0b00000}, 252}, // 0x044C, 0xD18C, 252 :: ь
+  {{0b00000, 0b00000, 0b01110, 0b10001, 0b00111, 0b10001, 0b01110, 0b00000}, 253}, // 0x044D, 0xD18D, 253 :: э
+  {{0b00000, 0b00000, 0b10010, 0b10101, 0b11101, 0b10101, 0b10010, 0b00000}, 254}, // 0x044E, 0xD18E, 254 :: ю
+  {{0b00000, 0b00000, 0b01111, 0b10001, 0b01111, 0b00101, 0b01001, 0b00000}, 255}  // 0x044F, 0xD18F, 255 :: я
+};
+static const uint8_t count_images = sizeof(rus_chars) / sizeof(image_char_t);
+
+const lcd_fallback_t lcd_fallbacks_default[] = {
+  {193, {225, '6', 0}},   // Б :: б, 6
+  {195, {227, 'r', 0}},   // Г :: г, r
+  {196, {228, 'D', 0}},   // Д :: д, D
+  {198, {230, '*', 0}},   // Ж :: ж, *
+  {199, {231, '3', 0}},   // З :: з, 3
+  {200, {232, 'U', 0}},   // И :: и, U
+  {201, {233, 200, 'U'}}, // Й :: й, И, U
+  {203, {235, 'J', 0}},   // Л :: л, J
+  {207, {239, 'n', 0}},   // П :: п, n
+  {211, {'Y', 0,   0}},   // У :: Y
+  {212, {244, 'O', 0}},   // Ф :: ф, O
+  {214, {246, 'U', 0}},   // Ц :: ц, U
+  {215, {247, '4', 0}},   // Ч :: ч, 4
+  {216, {248, 'W', 0}},   // Ш :: ш, W
+  {217, {249, 216, 'W'}}, // Щ :: щ, Ш, W
+  {218, {250, 'b', 0}},   // Ъ :: ъ, b
+  {219, {251, 'b', 0}},   // Ы :: ы, b
+  {220, {252, 'b', 0}},   // Ь :: ь, b
+  {221, {253, '3', 0}},   // Э :: э, 3
+  {222, {254, 'O', 0}},   // Ю :: ю, O
+  {223, {255, 'R', 0}},   // Я :: я, R
+  {225, {193, '6', 0}},   // б :: Б, 6
+  {226, {'B', 0,   0}},   // в :: B
+  {227, {195, 'r', 0}},   // г :: Г, r
+  {228, {196, 'g', 0}},   // д :: Д, g
+  {230, {198, '*', 0}},   // ж :: Ж, *
+  {231, {199, '3', 0}},   // з :: З, 3
+  {232, {200, 'u', 0}},   // и :: И, u
+  {233, {232, 'u', 0}},   // й :: и, u
+  {234, {'k', 0,   0}},   // к :: k
+  {235, {203, 'n', 0}},   // л :: Л, n
+  {236, {'m', 0,   0}},   // м :: m
+  {237, {'H', 0,   0}},   // н :: H
+  {239, {207, 'n', 0}},   // п :: П, n
+  {242, {'T', 0,   0}},   // т :: T
+  {244, {212, 'o', 0}},   // ф :: Ф, o
+  {246, {214, 'u', 0}},   // ц :: Ц, u
+  {247, {215, '4', 0}},   // ч :: Ч, 4
+  {248, {216, 'w', 0}},   // ш :: Ш, w
+  {249, {248, 'w', 0}},   // щ :: ш, w
+  {250, {252, 'b', 0}},   // ъ :: ь, b
+  {251, {219, 'b', 0}},   // ы :: Ы, b
+  {252, {220, 'b', 0}},   // ь :: Ь, b
+  {253, {221, '3', 0}},   // э :: Э, 3
+  {254, {222, 'o', 0}},   // ю :: Ю, o
+  {255, {223, 'R', 0}},   // я :: Я, R
+  {0,   {0,   0,   0}}
+};
+
+uint8_t lcdRomChar(uint8_t chr)
+{
+  // English alphabet without change
+  if (chr < 128) return chr;
+  // Russian alphabet using the same characters as the English alphabet
+  switch (chr) {
+    case 192: return 'A';
+    case 194: return 'B';
+    case 197: return 'E';
+    case 168: return 'E';
+    case 202: return 'K';
+    case 204: return 'M';
+    case 205: return 'H';
+    case 206: return 'O';
+    case 208: return 'P';
+    case 209: return 'C';
+    case 210: return 'T';
+    case 213: return 'X';
+    case 224: return 'a';
+    case 229: return 'e';
+    case 184: return 'e';
+    case 238: return 'o';
+    case 240: return 'p';
+    case 241: return 'c';
+    case 243: return 'y';
+    case 245: return 'x';
+    // cp1251 ° is the degree sign of the ROM
+    case 176: return 223;
+  };
+  return 0;
+}
+
+const uint8_t* lcdRusImage(uint8_t chr)
+{
+  for (uint8_t i = 0; i < count_images; i++) {
+    if (rus_chars[i].charcode == chr) {
+      return rus_chars[i].rastr;
+    };
+  };
+  return nullptr;
+}
+
+uint8_t lcdDecodeUTF8(const char* text, size_t len, size_t* pos)
+{
+  const uint8_t* str = (const uint8_t*)text;
+  size_t i = *pos;
+  // utf-8 D0 :: А..Я а..п
+  if ((i+1 < len) && (str[i] == 0xD0) && (str[i+1] >= 0x90) && (str[i+1] <= 0xBF)) {
+    *pos += 2;
+    return str[i+1]+0x30;
+  } 
+  // utf-8 D1 :: р..я
+  if ((i+1 < len) && (str[i] == 0xD1) && (str[i+1] >= 0x80) && (str[i+1] <= 0x8F)) {
+    *pos += 2;
+    return str[i+1]+0x70;
+  } 
+  // utf-8 C2 :: °
+  if ((i+1 < len) && (str[i] == 0xC2) && (str[i+1] == 0xB0)) {
+    *pos += 2;
+    return 0xB0;
+  } 
+  *pos += 1;
+  return str[i];
+}
+
+static bool needsImage(uint8_t chr)
+{
+  return (chr >= 128) && (lcdRomChar(chr) == 0) && (lcdRusImage(chr) != nullptr);
+}
+
+// Free locations hold 0, so code 0 never matches
+static int8_t findSlot(const lcd_cgram_plan_t* plan, uint8_t chr)
+{
+  if (chr == 0) return -1;
+  for (uint8_t i = 0; i < LCD_PLAN_SLOTS; i++) {
+    if ((plan->slots[i] == chr) && !(plan->reserved & (1 << i))) return i;
+  };
+  return -1;
+}
+
+void lcdPlanInit(lcd_cgram_plan_t* plan, const lcd_fallback_t* fallbacks)
+{
+  memset(plan, 0, sizeof(lcd_cgram_plan_t));
+  plan->fallbacks = fallbacks;
+}
+
+// Loaded images are kept, so a frame with the same chars does not require uploads
+void lcdPlanBegin(lcd_cgram_plan_t* plan, uint8_t reserved)
+{
+  memset(plan->count, 0, sizeof(plan->count));
+  plan->reserved = reserved;
+  for (uint8_t i = 0; i < LCD_PLAN_SLOTS; i++) {
+    if (reserved & (1 << i)) plan->slots[i] = 0;
+  };
+}
+
+void lcdPlanCount(lcd_cgram_plan_t* plan, const uint8_t* chars, size_t len)
+{
+  for (size_t i = 0; i < len; i++) {
+    if (needsImage(chars[i]) && (plan->count[chars[i] - 128] < 255)) {
+      plan->count[chars[i] - 128]++;
+    };
+  };
+}
+
+void lcdPlanCountUTF8(lcd_cgram_plan_t* plan, const char* text)
+{
+  size_t len = strlen(text);
+  size_t pos = 0;
+  while (pos < len) {
+    uint8_t chr = lcdDecodeUTF8(text, len, &pos);
+    lcdPlanCount(plan, &chr, 1);
+  };
+}
+
+// The most frequent chars get locations, chars already loaded win ties and keep their locations
+uint8_t lcdPlanSolve(lcd_cgram_plan_t* plan)
+{
+  uint8_t selected[LCD_PLAN_SLOTS];
+  uint8_t free = 0;
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < LCD_PLAN_SLOTS; i++) {
+    if (!(plan->reserved & (1 << i))) free++;
+  };
+
+  // Choose chars by frequency
+  while (count < free) {
+    int16_t best = -1;
+    for (uint8_t i = 0; i < 128; i++) {
+      if (plan->count[i] == 0) continue;
+      bool taken = false;
+      for (uint8_t j = 0; j < count; j++) {
+        if (selected[j] == i + 128) taken = true;
+      };
+      if (taken) continue;
+      if ((best < 0) || (plan->count[i] > plan->count[best]) 
+        || ((plan->count[i] == plan->count[best]) && (findSlot(plan, i + 128) >= 0) && (findSlot(plan, best + 128) < 0))) {
+        best = i;
+      };
+    };
+    if (best < 0) break;
+    selected[count++] = best + 128;
+  };
+
+  // Locations holding chosen chars are kept
+  uint8_t keep = plan->reserved;
+  for (uint8_t j = 0; j < count; j++) {
+    int8_t slot = findSlot(plan, selected[j]);
+    if (slot >= 0) keep |= (1 << slot);
+  };
+
+  // The rest are placed into free locations first, then over chars that are no longer needed
+  uint8_t upload = 0;
+  for (uint8_t j = 0; j < count; j++) {
+    if (findSlot(plan, selected[j]) >= 0) continue;
+    int8_t slot = -1;
+    for (uint8_t i = 0; i < LCD_PLAN_SLOTS; i++) {
+      if (keep & (1 << i)) continue;
+      if ((slot < 0) || (plan->slots[i] == 0)) slot = i;
+      if (plan->slots[i] == 0) break;
+    };
+    if (slot < 0) break;
+    plan->slots[slot] = selected[j];
+    keep |= (1 << slot);
+    upload |= (1 << slot);
+  };
+  return upload;
+}
+
+uint8_t lcdPlanResolve(const lcd_cgram_plan_t* plan, uint8_t chr)
+{
+  // Codes of CGRAM locations written by the application are shown as is
+  if (chr < LCD_PLAN_SLOTS) return chr;
+  uint8_t code = lcdRomChar(chr);
+  if (code != 0) return code;
+  int8_t slot = findSlot(plan, chr);
+  if (slot >= 0) return slot;
+  // Unknown char
+  if (lcdRusImage(chr) == nullptr) return chr;
+  // Substitutes in order of preference
+  if (plan->fallbacks) {
+    for (const lcd_fallback_t* item = plan->fallbacks; item->chr != 0; item++) {
+      if (item->chr != chr) continue;
+      for (uint8_t i = 0; (i < sizeof(item->alt)) && (item->alt[i] != 0); i++) {
+        code = lcdRomChar(item->alt[i]);
+        if (code != 0) return code;
+        slot = findSlot(plan, item->alt[i]);
+        if (slot >= 0) return slot;
+      };
+      break;
+    };
+  };
+  return '?';
+}
@@ -0,0 +1,163 @@
+/*
+   EN: HD44780 model for host tests: receives the lines of the parallel interface from reLCD::setPinWriter()
+       or the bytes of the PCF8574, executes instructions and checks the timing
+   RU: Модель HD44780 для тестов на хосте: получает линии параллельного интерфейса из reLCD::setPinWriter()
+       или байты PCF8574, выполняет инструкции и проверяет временные интервалы
+*/
+
+#ifndef __LCD_PIN_RECORDER_H__
+#define __LCD_PIN_RECORDER_H__
+
+#include <stdint.h>
+#include <string.h>
+#include "reLCD.h"
+
+typedef struct {
+  uint16_t lines;           // current state of the lines, LCD_PIN_xxx
+  bool     eightLines;      // D0-D3 are connected
+  bool     fourBit;         // interface set by the last function set
+  bool     highNibble;      // the next nibble is the high one
+  uint8_t  nibble;
+  bool     cgram;           // the address counter points to CGRAM
+  uint8_t  ac;
+  bool     increment;
+  bool     entryShift;      // the display shifts on every data write
+  int32_t  shift;           // display shift, chars to the left
+  uint8_t  control;         // display on, cursor, blink
+  uint8_t  ddram[128];
+  uint8_t  cgram_data[64];
+  int64_t  now;             // time counted by the delay hook, us
+  int64_t  enableTime;      // E went high
+  int64_t  disableTime;     // E went low
+  int64_t  readyTime;       // the controller accepts the next instruction
+  uint32_t instructions;    // commands and data bytes executed
+  uint32_t violations;      // timing or protocol errors
+} lcd_pin_recorder_t;
+
+static inline void recorderInit(lcd_pin_recorder_t* rec, bool eightLines)
+{
+  memset(rec, 0, sizeof(lcd_pin_recorder_t));
+  rec->eightLines = eightLines;
+  rec->highNibble = true;
+  rec->increment = true;
+  rec->disableTime = -1000;
+  memset(rec->ddram, ' ', sizeof(rec->ddram));
+}
+
+static inline void recorderExecute(lcd_pin_recorder_t* rec, uint8_t value, bool rs)
+{
+  if (rec->now < rec->readyTime) rec->violations++;
+  rec->instructions++;
+  uint32_t exec = 37;
+  if (rs) {
+    if (rec->cgram) {
+      rec->cgram_data[rec->ac & 0x3F] = value;
+    } else {
+      rec->ddram[rec->ac & 0x7F] = value;
+    };
+    rec->ac += rec->increment ? 1 : -1;
+    if (rec->entryShift && !rec->cgram) rec->shift += rec->increment ? 1 : -1;
+  } else if (value & 0x80) {
+    rec->cgram = false;
+    rec->ac = value & 0x7F;
+  } else if (value & 0x40) {
+    rec->cgram = true;
+    rec->ac = value & 0x3F;
+  } else if (value & 0x20) {
+    rec->fourBit = !(value & 0x10);
+    rec->highNibble = true;
+  } else if (value & 0x10) {
+    // cursor or display shift
+    if (value & 0x08) rec->shift += (value & 0x04) ? -1 : 1;
+  } else if (value & 0x08) {
+    rec->control = value & 0x07;
+  } else if (value & 0x04) {
+    rec->increment = value & 0x02;
+    rec->entryShift = value & 0x01;
+  } else if (value == 0x01) {
+    memset(rec->ddram, ' ', sizeof(rec->ddram));
+    rec->cgram = false;
+    rec->ac = 0;
+    rec->increment = true;
+    rec->shift = 0;
+    exec = 1520;
+  } else if ((value & 0xFE) == 0x02) {
+    rec->cgram = false;
+    rec->ac = 0;
+    rec->shift = 0;
+    exec = 1520;
+  };
+  rec->readyTime = rec->now + exec;
+}
+
+// The data is latched on the falling edge of E
+static inline void recorderLatch(lcd_pin_recorder_t* rec)
+{
+  uint8_t bus = rec->lines & 0xFF;
+  bool rs = rec->lines & LCD_PIN_RS;
+  if (!rec->fourBit) {
+    // after power on the controller works with 8 lines, D0-D3 may be not connected
+    recorderExecute(rec, rec->eightLines ? bus : (bus & 0xF0), rs);
+  } else if (rec->highNibble) {
+    rec->nibble = bus & 0xF0;
+    rec->highNibble = false;
+  } else {
+    rec->highNibble = true;
+    recorderExecute(rec, rec->nibble | (bus >> 4), rs);
+  };
+}
+
+static inline void recorderWrite(void* arg, uint16_t mask, uint16_t value)
+{
+  lcd_pin_recorder_t* rec = (lcd_pin_recorder_t*)arg;
+  uint16_t lines = (rec->lines & ~mask) | (value & mask);
+  bool enable = rec->lines & LCD_PIN_EN;
+  // RS and data must be stable while E is high
+  if (enable && ((lines ^ rec->lines) & (0xFF | LCD_PIN_RS))) rec->violations++;
+  if (!enable && (lines & LCD_PIN_EN)) {
+    // enable cycle must be > 1000 ns: E stays low for the rest of it
+    if (rec->now - rec->disableTime < 1) rec->violations++;
+    rec->enableTime = rec->now;
+  };
+  rec->lines = lines;
+  if (enable && !(lines & LCD_PIN_EN)) {
+    // enable pulse must be > 450 ns
+    if (rec->now - rec->enableTime < 1) rec->violations++;
+    rec->disableTime = rec->now;
+    recorderLatch(rec);
+  };
+}
+
+// PCF8574 backpack: P0 - RS, P1 - RW, P2 - E, P3 - backlight, P4-P7 - D4-D7
+static inline void recorderExpander(lcd_pin_recorder_t* rec, uint8_t data)
+{
+  uint16_t lines = (data & 0xF0)
+    | ((data & 0x01) ? LCD_PIN_RS : 0)
+    | ((data & 0x02) ? LCD_PIN_RW : 0)
+    | ((data & 0x04) ? LCD_PIN_EN : 0)
+    | ((data & 0x08) ? LCD_PIN_BL : 0);
+  recorderWrite(rec, 0xFFFF, lines);
+}
+
+static inline void recorderDelay(void* arg, uint32_t us)
+{
+  ((lcd_pin_recorder_t*)arg)->now += us;
+}
+
+// Address in DDRAM of a display cell
+static inline uint8_t recorderCell(const lcd_pin_recorder_t* rec, uint8_t col, uint8_t row)
+{
+  static const uint8_t offsets[4] = { 0x00, 0x40, 0x14, 0x54 };
+  return rec->ddram[offsets[row & 3] + col];
+}
+
+// Char shown in a visible cell: the display shift moves the window over each 40 char line
+static inline uint8_t recorderVisible(const lcd_pin_recorder_t* rec, uint8_t col, uint8_t row)
+{
+  static const uint8_t offsets[4] = { 0x00, 0x40, 0x14, 0x54 };
+  int32_t pos = ((offsets[row & 3] & 0x3F) + col + rec->shift) % 40;
+  if (pos < 0) pos += 40;
+  return rec->ddram[(offsets[row & 3] & 0x40) + pos];
+}
+
+#endif // __LCD_PIN_RECORDER_H__
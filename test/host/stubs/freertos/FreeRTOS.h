@@ -0,0 +1,11 @@
+#pragma once
+#include <stdint.h>
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef void* TaskHandle_t;
+typedef void* SemaphoreHandle_t;
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define portMAX_DELAY     ((TickType_t)0xFFFFFFFF)
+#define pdPASS            1
+#define pdTRUE            1
+void vTaskDelay(TickType_t ticks);
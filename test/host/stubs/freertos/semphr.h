@@ -0,0 +1,9 @@
+#pragma once
+#include "FreeRTOS.h"
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t wait);
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem);
+void vSemaphoreDelete(SemaphoreHandle_t sem);
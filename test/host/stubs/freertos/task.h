@@ -0,0 +1,6 @@
+#pragma once
+#include "FreeRTOS.h"
+BaseType_t xTaskCreate(void (*task)(void*), const char* name, uint32_t stack, void* arg, BaseType_t priority, TaskHandle_t* handle);
+void vTaskDelete(TaskHandle_t task);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait);
@@ -0,0 +1,20 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// Simulated time, us
+extern int64_t  host_time_us;
+// Calls of ets_delay_us() and vTaskDelay()
+extern uint32_t host_direct_waits;
+// Calls of gpio_set_level()
+extern uint32_t host_gpio_writes;
+// Calls of dedic_gpio_bundle_write()
+extern uint32_t host_bundle_writes;
+// dedic_gpio_new_bundle() succeeds
+extern bool     host_bundle_enabled;
+// Receives every GPIO level change, from single lines and from the bundle
+extern void   (*host_gpio_level)(int gpio, uint32_t level);
+// Receives every I2C transaction
+extern esp_err_t (*host_i2c_write)(uint8_t address, const uint8_t* data, size_t len);
@@ -0,0 +1,7 @@
+#pragma once
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#define BIT2 0x00000004
+#define BIT1 0x00000002
+#define BIT0 0x00000001
+#define esp_calloc calloc
@@ -0,0 +1,6 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "driver/i2c.h"
+esp_err_t writeI2C(i2c_port_t port, uint8_t address, uint8_t* cmds, size_t cmds_size, uint8_t* data, size_t data_size, uint32_t timeout);
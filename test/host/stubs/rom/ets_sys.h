@@ -0,0 +1,3 @@
+#pragma once
+#include <stdint.h>
+void ets_delay_us(uint32_t us);
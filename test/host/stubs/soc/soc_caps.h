@@ -0,0 +1,3 @@
+#pragma once
+#define SOC_DEDICATED_GPIO_SUPPORTED    1
+#define SOC_DEDIC_GPIO_OUT_CHANNELS_NUM 8
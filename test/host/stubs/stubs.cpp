@@ -0,0 +1,83 @@
+// Host replacements of the ESP-IDF and FreeRTOS calls used by the driver: no tasks, a single caller,
+// the time only moves when the test moves it. Direct waits are counted, with a delay hook there must be none
+#include "esp_timer.h"
+#include "rom/ets_sys.h"
+#include "reI2C.h"
+#include "driver/gpio.h"
+#include "driver/dedic_gpio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "host_stubs.h"
+
+int64_t  host_time_us = 0;
+uint32_t host_direct_waits = 0;
+uint32_t host_gpio_writes = 0;
+uint32_t host_bundle_writes = 0;
+bool     host_bundle_enabled = false;
+void   (*host_gpio_level)(int gpio, uint32_t level) = nullptr;
+esp_err_t (*host_i2c_write)(uint8_t address, const uint8_t* data, size_t len) = nullptr;
+
+struct dedic_gpio_bundle_t {
+  int    gpio[8];
+  size_t size;
+};
+static dedic_gpio_bundle_t host_bundle;
+
+int64_t esp_timer_get_time(void) { return host_time_us; }
+void ets_delay_us(uint32_t us) { host_direct_waits++; host_time_us += us; }
+void vTaskDelay(TickType_t ticks) { host_direct_waits++; host_time_us += (int64_t)ticks * 1000; }
+
+esp_err_t writeI2C(i2c_port_t, uint8_t address, uint8_t* cmds, size_t cmds_size, uint8_t*, size_t, uint32_t)
+{
+  if (host_i2c_write) return host_i2c_write(address, cmds, cmds_size);
+  return ESP_OK;
+}
+
+esp_err_t gpio_config(const gpio_config_t*) { return ESP_OK; }
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+  host_gpio_writes++;
+  if (host_gpio_level) host_gpio_level(gpio_num, level);
+  return ESP_OK;
+}
+
+// One bundle at a time, channel i drives gpio_array[i]
+esp_err_t dedic_gpio_new_bundle(const dedic_gpio_bundle_config_t* config, dedic_gpio_bundle_handle_t* ret_bundle)
+{
+  if (!host_bundle_enabled || (config->array_size > 8)) return ESP_FAIL;
+  for (size_t i = 0; i < config->array_size; i++) {
+    host_bundle.gpio[i] = config->gpio_array[i];
+  };
+  host_bundle.size = config->array_size;
+  *ret_bundle = &host_bundle;
+  return ESP_OK;
+}
+
+esp_err_t dedic_gpio_del_bundle(dedic_gpio_bundle_handle_t bundle)
+{
+  bundle->size = 0;
+  return ESP_OK;
+}
+
+void dedic_gpio_bundle_write(dedic_gpio_bundle_handle_t bundle, uint32_t mask, uint32_t value)
+{
+  host_bundle_writes++;
+  for (size_t i = 0; i < bundle->size; i++) {
+    if ((mask & (1 << i)) && host_gpio_level) host_gpio_level(bundle->gpio[i], (value >> i) & 1);
+  };
+}
+
+BaseType_t xTaskCreate(void (*)(void*), const char*, uint32_t, void*, BaseType_t, TaskHandle_t*) { return 0; }
+void vTaskDelete(TaskHandle_t) {}
+BaseType_t xTaskNotifyGive(TaskHandle_t) { return pdPASS; }
+uint32_t ulTaskNotifyTake(BaseType_t, TickType_t) { return 0; }
+
+static int host_mutex;
+SemaphoreHandle_t xSemaphoreCreateBinary(void) { return nullptr; }
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void) { return &host_mutex; }
+BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t) { return pdTRUE; }
+BaseType_t xSemaphoreGive(SemaphoreHandle_t) { return pdTRUE; }
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t, TickType_t) { return pdTRUE; }
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t) { return pdTRUE; }
+void vSemaphoreDelete(SemaphoreHandle_t) {}
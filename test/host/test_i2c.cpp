@@ -0,0 +1,434 @@
+// PCF8574 interface on the host: the bytes of every I2C transaction are clocked into the pin recorder
+#include <stdio.h>
+#include <string.h>
+#include "reLCD.h"
+#include "host_stubs.h"
+#include "lcd_pin_recorder.h"
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+  if (!(cond)) { \
+    printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+    failures++; \
+  }; \
+} while (0)
+
+#define I2C_ADDR      0x27
+#define I2C_BYTE_US   23      // 9 clocks at 400 kHz
+#define MAX_TRANS     512
+
+static lcd_pin_recorder_t rec;
+static uint32_t transCount;
+static uint32_t transBytes;
+static uint16_t transLen[MAX_TRANS];
+static int64_t  transStart[MAX_TRANS];
+static int64_t  transEnd[MAX_TRANS];
+static int      failAfter = -1;   // the next transaction breaks after this number of bytes
+
+static esp_err_t i2cWrite(uint8_t address, const uint8_t* data, size_t len)
+{
+  CHECK(address == I2C_ADDR);
+  if (failAfter >= 0) {
+    for (size_t i = 0; (i < len) && (i < (size_t)failAfter); i++) {
+      host_time_us += I2C_BYTE_US;
+      rec.now = host_time_us;
+      recorderExpander(&rec, data[i]);
+    };
+    failAfter = -1;
+    return ESP_FAIL;
+  };
+  if (transCount < MAX_TRANS) {
+    transLen[transCount] = len;
+    transStart[transCount] = host_time_us;
+  };
+  for (size_t i = 0; i < len; i++) {
+    host_time_us += I2C_BYTE_US;
+    rec.now = host_time_us;
+    recorderExpander(&rec, data[i]);
+  };
+  if (transCount < MAX_TRANS) transEnd[transCount] = host_time_us;
+  transCount++;
+  transBytes += len;
+  return ESP_OK;
+}
+
+static reLCD* start(uint8_t cols, uint8_t rows)
+{
+  recorderInit(&rec, false);
+  host_i2c_write = i2cWrite;
+  reLCD* lcd = new reLCD(I2C_NUM_0, I2C_ADDR, cols, rows);
+  lcd->init();
+  CHECK(rec.fourBit);
+  CHECK(rec.violations == 0);
+  return lcd;
+}
+
+static void resetCounters()
+{
+  transCount = 0;
+  transBytes = 0;
+  rec.instructions = 0;
+}
+
+static bool rowEquals(uint8_t row, uint8_t col, const char* text)
+{
+  for (uint8_t i = 0; text[i]; i++) {
+    if (recorderCell(&rec, col + i, row) != (uint8_t)text[i]) return false;
+  };
+  return true;
+}
+
+// Nibbles and E strobes reach the controller, only the changed cell is sent again
+static void testText()
+{
+  printf("text\n");
+  reLCD* lcd = start(20, 4);
+  lcd->printpos(0, 0, "Hello, world!");
+  lcd->printpos(3, 3, "12345");
+  CHECK(rowEquals(0, 0, "Hello, world!"));
+  CHECK(rowEquals(3, 3, "12345"));
+  resetCounters();
+  lcd->printpos(3, 3, "12346");
+  CHECK(rowEquals(3, 3, "12346"));
+  // address and char, 6 bytes each, in one transaction
+  CHECK(rec.instructions == 2);
+  CHECK(transCount == 1);
+  CHECK(transBytes == 12);
+  CHECK(rec.violations == 0);
+  delete lcd;
+}
+
+// With a frame rate cap, many changes of the same cells become one frame
+static void testCoalescing()
+{
+  printf("coalescing\n");
+  reLCD* lcd = start(20, 4);
+  lcd->setFrameRate(10);
+  host_time_us += 200000;
+  lcd->update();
+  resetCounters();
+  for (int i = 0; i < 100; i++) {
+    char text[8];
+    snprintf(text, sizeof(text), "%5d", i);
+    lcd->printpos(0, 1, text);
+    host_time_us += 1000;
+  };
+  host_time_us += 100000;
+  lcd->update();
+  CHECK(rowEquals(1, 0, "   99"));
+  // about 100 ms of changes: no more than two frames
+  CHECK(transCount <= 2);
+  CHECK(rec.violations == 0);
+  delete lcd;
+}
+
+// High priority cells bypass the frame rate, normal ones wait for the frame,
+// low ones are deferred while the previous frame kept the bus busy
+static void testPriority()
+{
+  printf("priority\n");
+  reLCD* lcd = start(20, 4);
+  lcd->setFrameRate(60);
+  lcd->setPriority(0, 0, 4, LCD_PRIORITY_HIGH);
+  lcd->setPriority(0, 3, 20, LCD_PRIORITY_LOW);
+  host_time_us += 100000;
+  lcd->update();
+  lcd->printpos(0, 0, "HIGH");
+  lcd->printpos(0, 1, "normal");
+  CHECK(rowEquals(0, 0, "HIGH"));
+  CHECK(!rowEquals(1, 0, "normal"));
+  CHECK(lcd->isPending());
+  host_time_us += 17000;
+  CHECK(lcd->update());
+  CHECK(rowEquals(1, 0, "normal"));
+
+  // a full page takes more than half of the frame time
+  lcd->printpos(0, 0, "AAAAAAAAAAAAAAAAAAAA");
+  lcd->printpos(0, 1, "BBBBBBBBBBBBBBBBBBBB");
+  lcd->printpos(0, 2, "CCCCCCCCCCCCCCCCCCCC");
+  lcd->printpos(0, 3, "DDDDDDDDDDDDDDDDDDDD");
+  host_time_us += 17000;
+  lcd->update();
+  CHECK(rowEquals(3, 0, "DDDDDDDDDDDDDDDDDDDD"));
+  lcd->printpos(0, 1, "bbbbbbbbbbbbbbbbbbbb");
+  lcd->printpos(0, 3, "dddddddddddddddddddd");
+  host_time_us += 17000;
+  lcd->update();
+  CHECK(rowEquals(1, 0, "bbbbbbbbbbbbbbbbbbbb"));
+  CHECK(rowEquals(3, 0, "DDDDDDDDDDDDDDDDDDDD"));
+  CHECK(lcd->isPending());
+  // the short frame released the bus, the low priority row follows
+  host_time_us += 17000;
+  lcd->update();
+  CHECK(rowEquals(3, 0, "dddddddddddddddddddd"));
+  CHECK(!lcd->isPending());
+  CHECK(rec.violations == 0);
+  delete lcd;
+}
+
+// A transaction broken after one nibble is not repeated: the display is initialized again and redrawn
+static void testResync()
+{
+  printf("resync\n");
+  reLCD* lcd = start(20, 4);
+  uint8_t heart[8] = { 0x00, 0x0A, 0x1F, 0x1F, 0x0E, 0x04, 0x00, 0x00 };
+  lcd->createChar(2, heart);
+  lcd->printpos(0, 0, "Hello");
+  lcd->setCursor(6, 0);
+  lcd->write(2);
+  failAfter = 3;
+  lcd->printpos(0, 1, "world");
+  // the display waits for the second nibble of the address command
+  CHECK(!rec.highNibble);
+  host_time_us += 10000;
+  lcd->printpos(0, 2, "again");
+  CHECK(rec.highNibble);
+  CHECK(rec.fourBit);
+  CHECK(rowEquals(0, 0, "Hello "));
+  CHECK(recorderCell(&rec, 6, 0) == 2);
+  CHECK(rowEquals(1, 0, "world"));
+  CHECK(rowEquals(2, 0, "again"));
+  CHECK(memcmp(&rec.cgram_data[2 * 8], heart, 8) == 0);
+  CHECK(rec.violations == 0);
+  #if CONFIG_LCD_STATS
+    lcd_stats_t stats;
+    lcd->getStats(&stats);
+    CHECK(stats.failures == 1);
+    CHECK(stats.resyncs == 1);
+  #endif // CONFIG_LCD_STATS
+  delete lcd;
+}
+
+// The cursor moves in the entry direction
+static void testRightToLeft()
+{
+  printf("right to left\n");
+  reLCD* lcd = start(16, 2);
+  lcd->setRightToLeft(true);
+  lcd->printpos(10, 0, "abc");
+  CHECK(rowEquals(0, 8, "cba"));
+  lcd_state_t state;
+  lcd->getState(&state);
+  CHECK(state.col == 7);
+  lcd->setRightToLeft(false);
+  lcd->printstr("xy");
+  CHECK(rowEquals(0, 7, "xyba"));
+  CHECK(rec.violations == 0);
+  delete lcd;
+}
+
+// Columns beyond the visible ones are kept in DDRAM and shown by scrolling
+static void testHiddenColumns()
+{
+  printf("hidden columns\n");
+  reLCD* lcd = start(16, 2);
+  lcd_state_t state;
+  lcd->getState(&state);
+  CHECK(state.width == 40);
+  lcd->printpos(16, 0, "more");
+  CHECK(rowEquals(0, 16, "more"));
+  CHECK(memcmp(lcd->getScreenRow(0) + 16, "more", 4) == 0);
+  for (uint8_t i = 0; i < 4; i++) {
+    lcd->scrollDisplayLeft();
+  };
+  CHECK(recorderVisible(&rec, 12, 0) == 'm');
+  CHECK(recorderVisible(&rec, 15, 0) == 'e');
+  // the last column of DDRAM, the next char goes to the next row
+  lcd->printpos(39, 0, "ab");
+  CHECK(recorderCell(&rec, 39, 0) == 'a');
+  CHECK(recorderCell(&rec, 0, 1) == 'b');
+  CHECK(rec.violations == 0);
+  delete lcd;
+}
+
+// Every char written with autoscroll shifts the display, spaces and repeated chars too
+static void testAutoscroll()
+{
+  printf("autoscroll\n");
+  reLCD* lcd = start(16, 2);
+  lcd->setFrameRate(10);
+  host_time_us += 200000;
+  lcd->printpos(0, 0, "pending");
+  lcd->setCursor(16, 1);
+  lcd->setAutoscroll(true);
+  CHECK(rowEquals(0, 0, "pending"));
+  lcd->printstr("11 11");
+  CHECK(rec.shift == 5);
+  for (uint8_t i = 0; i < 5; i++) {
+    CHECK(recorderVisible(&rec, 11 + i, 1) == (uint8_t)"11 11"[i]);
+  };
+  // without autoscroll the text is collected into frames again
+  lcd->setAutoscroll(false);
+  lcd->printpos(0, 0, "later");
+  CHECK(rowEquals(0, 0, "pending"));
+  host_time_us += 200000;
+  lcd->update();
+  CHECK(rowEquals(0, 0, "laterng"));
+  CHECK(rec.shift == 5);
+  CHECK(rec.violations == 0);
+  delete lcd;
+}
+
+// Transactions of one frame hold whole commands, are not longer than the slice and leave the bus free between them
+static void testBusSlice()
+{
+  printf("bus slice\n");
+  reLCD* lcd = start(20, 4);
+  lcd->setFrameRate(10);
+  lcd->setBusSlice(24, 2);
+  host_time_us += 200000;
+  lcd->update();
+  lcd->printpos(0, 0, "AAAAAAAAAAAAAAAAAAAA");
+  lcd->printpos(0, 1, "BBBBBBBBBBBBBBBBBBBB");
+  lcd->printpos(0, 2, "CCCCCCCCCCCCCCCCCCCC");
+  resetCounters();
+  host_time_us += 200000;
+  lcd->update();
+  CHECK(rowEquals(2, 0, "CCCCCCCCCCCCCCCCCCCC"));
+  CHECK(transCount > 10);
+  CHECK(transCount <= MAX_TRANS);
+  for (uint32_t i = 0; (i < transCount) && (i < MAX_TRANS); i++) {
+    CHECK(transLen[i] <= 24);
+    CHECK(transLen[i] % 6 == 0);
+    if (i > 0) CHECK(transStart[i] - transEnd[i - 1] >= 2000);
+  };
+  CHECK(rec.violations == 0);
+  delete lcd;
+}
+
+// CGRAM images of russian chars are charged to the frame budget and spread over several frames
+static void testBudgetImages()
+{
+  printf("frame budget and CGRAM\n");
+  static const uint8_t chars[6] = { 193, 196, 198, 200, 203, 207 };
+  reLCD* lcd = start(20, 4);
+  lcd->setFrameRate(10);
+  lcd->setFrameBudget(60);
+  host_time_us += 200000;
+  lcd->update();
+  lcd->printpos(0, 0, "\xd0\x91\xd0\x94\xd0\x96\xd0\x98\xd0\x9b\xd0\x9f");   // БДЖИЛП
+  uint8_t frames = 0;
+  while (lcd->isPending() && (frames < 30)) {
+    resetCounters();
+    host_time_us += 200000;
+    lcd->update();
+    // the budget is checked before every image: 9 commands of 6 bytes may overrun it
+    CHECK(transBytes < 60 + 54);
+    frames++;
+  };
+  CHECK(!lcd->isPending());
+  CHECK(frames > 2);
+  for (uint8_t col = 0; col < 6; col++) {
+    uint8_t code = recorderCell(&rec, col, 0);
+    CHECK(code < 8);
+    CHECK(memcmp(&rec.cgram_data[code * 8], lcdRusImage(chars[col]), 8) == 0);
+  };
+  CHECK(rec.violations == 0);
+  delete lcd;
+}
+
+// A new frame of the animation rewrites only the changed rows of the image, createChar() stops the animation
+static void testAnimation()
+{
+  printf("animation\n");
+  static const uint8_t frames[2][8] = {
+    { 0x00, 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x00 },
+    { 0x00, 0x04, 0x0E, 0x04, 0x04, 0x1F, 0x00, 0x00 }
+  };
+  static const lcd_animation_t blink = { frames, 2, 100 };
+  reLCD* lcd = start(16, 2);
+  CHECK(lcd->startAnimation(5, &blink));
+  CHECK(memcmp(&rec.cgram_data[5 * 8], frames[0], 8) == 0);
+  lcd->setCursor(3, 1);
+  lcd->write(5);
+  CHECK(recorderCell(&rec, 3, 1) == 5);
+  resetCounters();
+  host_time_us += 100000;
+  CHECK(lcd->update());
+  CHECK(memcmp(&rec.cgram_data[5 * 8], frames[1], 8) == 0);
+  // rows 2 and 5: an address and a row each, the cell itself is not sent
+  CHECK(rec.instructions == 4);
+  CHECK(recorderCell(&rec, 3, 1) == 5);
+
+  uint8_t image[8] = { 0x1F, 0x11, 0x11, 0x11, 0x11, 0x11, 0x1F, 0x00 };
+  lcd->createChar(5, image);
+  host_time_us += 300000;
+  lcd->update();
+  CHECK(memcmp(&rec.cgram_data[5 * 8], image, 8) == 0);
+  CHECK(rec.violations == 0);
+  delete lcd;
+}
+
+// Cursor moves and the display shift change the sequence, the shift survives a resync
+static void testStateSequence()
+{
+  printf("state and sequence\n");
+  reLCD* lcd = start(16, 2);
+  lcd_state_t state;
+  uint32_t sequence = lcd->getSequence();
+  lcd->setCursor(5, 1);
+  CHECK(lcd->getSequence() != sequence);
+  CHECK((lcd->getSequence() & 1) == 0);
+  sequence = lcd->getSequence();
+  lcd->printpos(0, 0, "abcdefghijklmnopqr");
+  CHECK(lcd->getSequence() != sequence);
+
+  sequence = lcd->getSequence();
+  lcd->scrollDisplayLeft();
+  lcd->scrollDisplayLeft();
+  CHECK(lcd->getSequence() != sequence);
+  lcd->getState(&state);
+  CHECK(state.shift == 2);
+  CHECK(rec.shift == 2);
+  char utf8[64];
+  lcd->exportUTF8(0, utf8, sizeof(utf8));
+  CHECK(strcmp(utf8, "cdefghijklmnopqr") == 0);
+
+  sequence = lcd->getSequence();
+  lcd->home();
+  CHECK(lcd->getSequence() != sequence);
+  lcd->getState(&state);
+  CHECK(state.shift == 0);
+  CHECK(rec.shift == 0);
+  lcd->scrollDisplayRight();
+  lcd->getState(&state);
+  CHECK(state.shift == 39);
+  lcd->exportUTF8(0, utf8, sizeof(utf8));
+  CHECK(strcmp(utf8, " abcdefghijklmno") == 0);
+
+  // the shift is restored after the display is initialized again
+  lcd->scrollDisplayLeft();
+  lcd->scrollDisplayLeft();
+  lcd->scrollDisplayLeft();
+  failAfter = 3;
+  lcd->printpos(0, 1, "x");
+  lcd->printpos(1, 1, "y");
+  CHECK(rec.shift == 2);
+  CHECK(recorderVisible(&rec, 0, 0) == 'c');
+  CHECK(recorderCell(&rec, 0, 1) == 'x');
+  CHECK(recorderCell(&rec, 1, 1) == 'y');
+  CHECK(rec.violations == 0);
+  delete lcd;
+}
+
+int main()
+{
+  testText();
+  testCoalescing();
+  testPriority();
+  testResync();
+  testRightToLeft();
+  testHiddenColumns();
+  testAutoscroll();
+  testBusSlice();
+  testBudgetImages();
+  testAnimation();
+  testStateSequence();
+  if (failures) {
+    printf("FAILED: %d\n", failures);
+    return 1;
+  };
+  printf("OK\n");
+  return 0;
+}
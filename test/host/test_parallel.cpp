@@ -0,0 +1,172 @@
+// Parallel interface on the host: the pin recorder plays the display, the delay hook plays the time
+#include <stdio.h>
+#include <string.h>
+#include "reLCD.h"
+#include "host_stubs.h"
+#include "lcd_pin_recorder.h"
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+  if (!(cond)) { \
+    printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+    failures++; \
+  }; \
+} while (0)
+
+static lcd_gpio_config_t makeConfig(uint8_t bitmode)
+{
+  lcd_gpio_config_t cfg;
+  cfg.rs = (gpio_num_t)1;
+  cfg.rw = GPIO_NUM_NC;
+  cfg.en = (gpio_num_t)2;
+  for (uint8_t i = 0; i < 8; i++) {
+    cfg.data[i] = (gpio_num_t)(10 + i);
+  };
+  cfg.backlight = GPIO_NUM_NC;
+  cfg.bitmode = bitmode;
+  return cfg;
+}
+
+static bool rowEquals(const lcd_pin_recorder_t* rec, uint8_t row, const char* text)
+{
+  for (uint8_t col = 0; text[col]; col++) {
+    if (recorderCell(rec, col, row) != (uint8_t)text[col]) return false;
+  };
+  return true;
+}
+
+static void testInterface(uint8_t bitmode)
+{
+  printf("parallel interface, %s\n", bitmode == LCD_8BITMODE ? "8-bit" : "4-bit");
+  lcd_pin_recorder_t rec;
+  recorderInit(&rec, bitmode == LCD_8BITMODE);
+  lcd_gpio_config_t cfg = makeConfig(bitmode);
+  reLCD* lcd = new reLCD(&cfg, 20, 4);
+  lcd->setPinWriter(recorderWrite, &rec, recorderDelay);
+  host_direct_waits = 0;
+  host_gpio_writes = 0;
+  host_bundle_writes = 0;
+  lcd->init();
+  // all waits went through the hook, all lines through the writer
+  CHECK(host_direct_waits == 0);
+  CHECK(host_gpio_writes == 0);
+  CHECK(host_bundle_writes == 0);
+  CHECK(rec.fourBit == (bitmode != LCD_8BITMODE));
+  CHECK(rec.violations == 0);
+
+  lcd->printpos(0, 0, "Hello, world!");
+  lcd->printpos(3, 2, "12345");
+  CHECK(rowEquals(&rec, 0, "Hello, world!"));
+  CHECK(rowEquals(&rec, 2, "   12345"));
+
+  // only the changed cell is sent
+  uint32_t before = rec.instructions;
+  lcd->printpos(3, 2, "12346");
+  CHECK(rowEquals(&rec, 2, "   12346"));
+  CHECK(rec.instructions - before == 2);
+
+  // the frame budget counts commands and chars on the parallel interface too
+  lcd->clear();
+  lcd->setFrameBudget(6);
+  lcd->printpos(0, 3, "ABCDEFGHIJKLMNOP");
+  CHECK(lcd->isPending());
+  uint8_t frames = 1;
+  while (lcd->isPending() && (frames < 20)) {
+    before = rec.instructions;
+    lcd->update();
+    // the budget is checked before every cell, one cell may overrun it by its address command
+    CHECK(rec.instructions - before <= 7);
+    frames++;
+  };
+  CHECK(!lcd->isPending());
+  CHECK(frames > 2);
+  CHECK(rowEquals(&rec, 3, "ABCDEFGHIJKLMNOP"));
+  lcd->setFrameBudget(0);
+
+  // custom chars: the image reaches CGRAM, the cell shows the location
+  uint8_t heart[8] = { 0x00, 0x0A, 0x1F, 0x1F, 0x0E, 0x04, 0x00, 0x00 };
+  lcd->createChar(3, heart);
+  lcd->setCursor(19, 1);
+  lcd->write(3);
+  CHECK(memcmp(&rec.cgram_data[3 * 8], heart, 8) == 0);
+  CHECK(recorderCell(&rec, 19, 1) == 3);
+
+  // mirror: the sequence is even between calls, sent russian chars are exported as written
+  uint32_t sequence = lcd->getSequence();
+  lcd->printpos(0, 1, "\xd0\x9f\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82");   // Привет
+  CHECK(lcd->getSequence() != sequence);
+  CHECK((lcd->getSequence() & 1) == 0);
+  char utf8[64];
+  lcd->exportUTF8(1, utf8, sizeof(utf8));
+  CHECK(strncmp(utf8, "\xd0\x9f\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82 ", 13) == 0);
+
+  // a page with more russian chars than CGRAM locations does not overwrite the application image
+  lcd->printpos(0, 2, "\xd0\x91\xd0\x94\xd0\x96\xd0\x98\xd0\x9b\xd0\x9f\xd0\xa4\xd0\xa6\xd0\xa7\xd0\xa8");   // БДЖИЛПФЦЧШ
+  CHECK(memcmp(&rec.cgram_data[3 * 8], heart, 8) == 0);
+  CHECK(recorderCell(&rec, 19, 1) == 3);
+  for (uint8_t col = 0; col < 10; col++) {
+    CHECK(recorderCell(&rec, col, 2) != 3);
+  };
+
+  CHECK(rec.violations == 0);
+  CHECK(host_direct_waits == 0);
+  delete lcd;
+}
+
+// Levels of the real GPIO lines are passed to the recorder, the time is the time of the stubs
+static lcd_pin_recorder_t* gpioRecorder = nullptr;
+
+static void gpioLevel(int gpio, uint32_t level)
+{
+  uint16_t pin = 0;
+  if (gpio == 1) pin = LCD_PIN_RS;
+  else if (gpio == 2) pin = LCD_PIN_EN;
+  else if ((gpio >= 10) && (gpio < 18)) pin = 1 << (gpio - 10);
+  CHECK(pin != 0);
+  gpioRecorder->now = host_time_us;
+  recorderWrite(gpioRecorder, pin, level ? pin : 0);
+}
+
+static void testBundle(uint8_t bitmode)
+{
+  printf("dedicated GPIO bundle, %s\n", bitmode == LCD_8BITMODE ? "8-bit" : "4-bit");
+  lcd_pin_recorder_t rec;
+  recorderInit(&rec, bitmode == LCD_8BITMODE);
+  gpioRecorder = &rec;
+  host_gpio_level = gpioLevel;
+  host_bundle_enabled = true;
+  lcd_gpio_config_t cfg = makeConfig(bitmode);
+  reLCD* lcd = new reLCD(&cfg, 16, 2);
+  lcd->init();
+  host_gpio_writes = 0;
+  host_bundle_writes = 0;
+  lcd->printpos(0, 1, "Bundle");
+  CHECK(rowEquals(&rec, 1, "Bundle"));
+  CHECK(host_bundle_writes > 0);
+  if (bitmode == LCD_8BITMODE) {
+    // 8 data lines fill the bundle, RS and E are switched one by one
+    CHECK(host_gpio_writes > 0);
+  } else {
+    // D4-D7, RS and E are all in the bundle
+    CHECK(host_gpio_writes == 0);
+  };
+  CHECK(rec.violations == 0);
+  delete lcd;
+  host_bundle_enabled = false;
+  host_gpio_level = nullptr;
+}
+
+int main()
+{
+  testInterface(LCD_4BITMODE);
+  testInterface(LCD_8BITMODE);
+  testBundle(LCD_4BITMODE);
+  testBundle(LCD_8BITMODE);
+  if (failures) {
+    printf("FAILED: %d\n", failures);
+    return 1;
+  };
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,134 @@
+// CGRAM planner on the host: no ESP-IDF, only reLCDPlanner
+#include <stdio.h>
+#include <string.h>
+#include "reLCDPlanner.h"
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+  if (!(cond)) { \
+    printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+    failures++; \
+  }; \
+} while (0)
+
+// cp1251
+#define CHR_YA_UPPER  223   // Я
+#define CHR_YA_LOWER  255   // я
+#define CHR_BE_UPPER  193   // Б
+#define CHR_SHCHA     217   // Щ
+#define CHR_SHA_LOWER 248   // ш
+#define CHR_DEGREE    176   // °
+
+static uint8_t plan(lcd_cgram_plan_t* p, uint8_t reserved, const char* text)
+{
+  lcdPlanBegin(p, reserved);
+  lcdPlanCountUTF8(p, text);
+  return lcdPlanSolve(p);
+}
+
+static int8_t slotOf(const lcd_cgram_plan_t* p, uint8_t chr)
+{
+  for (uint8_t i = 0; i < LCD_PLAN_SLOTS; i++) {
+    if (p->slots[i] == chr) return i;
+  };
+  return -1;
+}
+
+// Codes of CGRAM locations are never remapped, even when location 0 is free and another one is reserved
+static void testSlotCodes()
+{
+  printf("slot codes\n");
+  lcd_cgram_plan_t p;
+  lcdPlanInit(&p, lcd_fallbacks_default);
+  lcdPlanBegin(&p, 0x01);
+  CHECK(lcdPlanSolve(&p) == 0);
+  for (uint8_t chr = 0; chr < LCD_PLAN_SLOTS; chr++) {
+    CHECK(lcdPlanResolve(&p, chr) == chr);
+  };
+  // with a russian char loaded into location 1, code 0 still stays 0
+  CHECK(plan(&p, 0x01, "\xd0\x91") == 0x02);   // Б
+  CHECK(lcdPlanResolve(&p, CHR_BE_UPPER) == 1);
+  CHECK(lcdPlanResolve(&p, 0) == 0);
+  CHECK(lcdPlanResolve(&p, 1) == 1);
+}
+
+// Я needs an image, ° is taken from the ROM
+static void testYaAndDegree()
+{
+  printf("Ya and degree\n");
+  const char* text = "\xd0\xaf\xd0\xbd\xd0\xb2 25\xc2\xb0" "C";   // Янв 25°C
+  size_t len = strlen(text);
+  size_t pos = 0;
+  CHECK(lcdDecodeUTF8(text, len, &pos) == CHR_YA_UPPER);
+  pos = len - 3;
+  CHECK(lcdDecodeUTF8(text, len, &pos) == CHR_DEGREE);
+  CHECK(pos == len - 1);
+
+  CHECK(lcdRomChar(CHR_YA_UPPER) == 0);
+  CHECK(lcdRomChar(CHR_DEGREE) == 0xDF);
+  CHECK(lcdRusImage(CHR_YA_UPPER) != nullptr);
+
+  lcd_cgram_plan_t p;
+  lcdPlanInit(&p, lcd_fallbacks_default);
+  CHECK(plan(&p, 0, text) != 0);
+  int8_t slot = slotOf(&p, CHR_YA_UPPER);
+  CHECK(slot >= 0);
+  CHECK(lcdPlanResolve(&p, CHR_YA_UPPER) == slot);
+  CHECK(lcdPlanResolve(&p, CHR_DEGREE) == 0xDF);
+}
+
+// Reserved locations are never planned, the same text needs no uploads
+static void testReservedAndStable()
+{
+  printf("reserved and stable\n");
+  const char* text = "\xd0\x91\xd0\x94\xd0\x96\xd0\x98\xd0\x9b\xd0\x9f";   // БДЖИЛП
+  lcd_cgram_plan_t p;
+  lcdPlanInit(&p, lcd_fallbacks_default);
+  uint8_t upload = plan(&p, 0xF0, text);
+  CHECK(upload == 0x0F);
+  for (uint8_t i = 4; i < LCD_PLAN_SLOTS; i++) {
+    CHECK(p.slots[i] == 0);
+  };
+  CHECK(plan(&p, 0xF0, text) == 0);
+  // a frame with some of the same chars keeps their locations
+  uint8_t slots[LCD_PLAN_SLOTS];
+  memcpy(slots, p.slots, sizeof(slots));
+  upload = plan(&p, 0xF0, "\xd0\x91\xd0\x94\xd0\xa4");   // БДФ
+  for (uint8_t i = 0; i < LCD_PLAN_SLOTS; i++) {
+    if ((slots[i] == CHR_BE_UPPER) || (slots[i] == 196)) {
+      CHECK(p.slots[i] == slots[i]);
+      CHECK(!(upload & (1 << i)));
+    };
+  };
+  CHECK(slotOf(&p, 212) >= 0);   // Ф
+}
+
+// Chars left without a location are shown by ranked substitutes
+static void testFallbacks()
+{
+  printf("fallbacks\n");
+  lcd_cgram_plan_t p;
+  lcdPlanInit(&p, lcd_fallbacks_default);
+  // ш is the most frequent, Щ does not fit
+  plan(&p, 0xFE, "\xd1\x88\xd1\x88\xd0\xa9");   // шшЩ
+  CHECK(slotOf(&p, CHR_SHA_LOWER) == 0);
+  CHECK(lcdPlanResolve(&p, CHR_SHCHA) == 'W');
+  CHECK(lcdPlanResolve(&p, CHR_YA_LOWER) == 'R');
+  lcdPlanInit(&p, nullptr);
+  CHECK(lcdPlanResolve(&p, CHR_SHCHA) == '?');
+}
+
+int main()
+{
+  testSlotCodes();
+  testYaAndDegree();
+  testReservedAndStable();
+  testFallbacks();
+  if (failures) {
+    printf("FAILED: %d\n", failures);
+    return 1;
+  };
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,53 @@
+// Display with russian chars in the ROM (CONFIG_LCD_RUS_CODEPAGE 1): cp1251 codes are sent as they are, ° is 0xDF
+#include <stdio.h>
+#include <string.h>
+#include "reLCD.h"
+#include "host_stubs.h"
+#include "lcd_pin_recorder.h"
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+  if (!(cond)) { \
+    printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+    failures++; \
+  }; \
+} while (0)
+
+static void testDegree()
+{
+  printf("rom codepage, degree\n");
+  lcd_pin_recorder_t rec;
+  recorderInit(&rec, false);
+  lcd_gpio_config_t cfg;
+  cfg.rs = (gpio_num_t)1;
+  cfg.rw = GPIO_NUM_NC;
+  cfg.en = (gpio_num_t)2;
+  for (uint8_t i = 0; i < 8; i++) {
+    cfg.data[i] = (gpio_num_t)(10 + i);
+  };
+  cfg.backlight = GPIO_NUM_NC;
+  cfg.bitmode = LCD_4BITMODE;
+  reLCD* lcd = new reLCD(&cfg, 16, 2);
+  lcd->setPinWriter(recorderWrite, &rec, recorderDelay);
+  lcd->init();
+  lcd->printpos(0, 0, "25\xc2\xb0" "C \xd0\xaf");   // 25°C Я
+  CHECK(recorderCell(&rec, 2, 0) == 0xDF);
+  CHECK(recorderCell(&rec, 5, 0) == 0xDF);
+  char utf8[64];
+  lcd->exportUTF8(0, utf8, sizeof(utf8));
+  CHECK(strncmp(utf8, "25\xc2\xb0" "C \xd0\xaf ", 9) == 0);
+  CHECK(rec.violations == 0);
+  delete lcd;
+}
+
+int main()
+{
+  testDegree();
+  if (failures) {
+    printf("FAILED: %d\n", failures);
+    return 1;
+  };
+  printf("OK\n");
+  return 0;
+}